@@ -0,0 +1,492 @@
+#ifndef CENTROID_TABLE_CPP
+#define CENTROID_TABLE_CPP
+
+/**
+ * The nearest-centroid (assignment) kernel used by k-means.  See
+ * CentroidTable.h for the layout of the centroids.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#include "CentroidTable.h"
+
+// The kernel below is written once against a tiny set of vector
+// operations.  Each of the following "Isa" structures implements
+// these operations for one instruction set and precision.  The index
+// of the best centroid is tracked as a Real so that it can be blended
+// with the same instructions as the distances (exact for any sane k).
+
+/** The portable fallback that processes one centroid at a time. */
+template<typename Real>
+struct ScalarIsa {
+    using Vec  = Real;
+    using Mask = bool;
+    static constexpr int Width = 1;
+    static const char* name() { return "scalar"; }
+    static Vec load(const Real* p)         { return *p; }
+    static Vec set1(const Real v)          { return v; }
+    static Vec iota()                      { return 0; }
+    static Vec add(Vec a, Vec b)           { return a + b; }
+    static Vec sub(Vec a, Vec b)           { return a - b; }
+    static Vec mul(Vec a, Vec b)           { return a * b; }
+    static Vec fma(Vec a, Vec b, Vec c)    { return a * b + c; }
+    static Mask less(Vec a, Vec b)         { return a < b; }
+    static Vec blend(Mask m, Vec a, Vec b) { return m ? a : b; }
+    static void store(Real* p, Vec v)      { *p = v; }
+};
+
+#ifdef __AVX2__
+/** The 256-bit AVX2 registers, specialized for each precision. */
+template<typename Real>
+struct Avx2Isa;
+
+/** Four double-precision centroids at a time. */
+template<>
+struct Avx2Isa<double> {
+    using Vec  = __m256d;
+    using Mask = __m256d;
+    static constexpr int Width = 4;
+    static const char* name() { return "avx2"; }
+    static Vec load(const double* p) { return _mm256_loadu_pd(p); }
+    static Vec set1(const double v)  { return _mm256_set1_pd(v); }
+    static Vec iota()                { return _mm256_setr_pd(0, 1, 2, 3); }
+    static Vec add(Vec a, Vec b)     { return _mm256_add_pd(a, b); }
+    static Vec sub(Vec a, Vec b)     { return _mm256_sub_pd(a, b); }
+    static Vec mul(Vec a, Vec b)     { return _mm256_mul_pd(a, b); }
+#ifdef __FMA__
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_pd(a, b, c); }
+#else
+    static Vec fma(Vec a, Vec b, Vec c) { return add(mul(a, b), c); }
+#endif
+    static Mask less(Vec a, Vec b)   { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Vec blend(Mask m, Vec a, Vec b) {
+        return _mm256_blendv_pd(b, a, m);
+    }
+    static void store(double* p, Vec v) { _mm256_storeu_pd(p, v); }
+};
+
+/** Eight single-precision centroids at a time. */
+template<>
+struct Avx2Isa<float> {
+    using Vec  = __m256;
+    using Mask = __m256;
+    static constexpr int Width = 8;
+    static const char* name() { return "avx2"; }
+    static Vec load(const float* p) { return _mm256_loadu_ps(p); }
+    static Vec set1(const float v)  { return _mm256_set1_ps(v); }
+    static Vec iota() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    static Vec add(Vec a, Vec b)    { return _mm256_add_ps(a, b); }
+    static Vec sub(Vec a, Vec b)    { return _mm256_sub_ps(a, b); }
+    static Vec mul(Vec a, Vec b)    { return _mm256_mul_ps(a, b); }
+#ifdef __FMA__
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    static Vec fma(Vec a, Vec b, Vec c) { return add(mul(a, b), c); }
+#endif
+    static Mask less(Vec a, Vec b)  { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Vec blend(Mask m, Vec a, Vec b) {
+        return _mm256_blendv_ps(b, a, m);
+    }
+    static void store(float* p, Vec v) { _mm256_storeu_ps(p, v); }
+};
+#endif
+
+#ifdef __AVX512F__
+/** The 512-bit AVX-512 registers, specialized for each precision. */
+template<typename Real>
+struct Avx512Isa;
+
+/** Eight double-precision centroids at a time. */
+template<>
+struct Avx512Isa<double> {
+    using Vec  = __m512d;
+    using Mask = __mmask8;
+    static constexpr int Width = 8;
+    static const char* name() { return "avx512"; }
+    static Vec load(const double* p) { return _mm512_loadu_pd(p); }
+    static Vec set1(const double v)  { return _mm512_set1_pd(v); }
+    static Vec iota() { return _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7); }
+    static Vec add(Vec a, Vec b)     { return _mm512_add_pd(a, b); }
+    static Vec sub(Vec a, Vec b)     { return _mm512_sub_pd(a, b); }
+    static Vec mul(Vec a, Vec b)     { return _mm512_mul_pd(a, b); }
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_pd(a, b, c); }
+    static Mask less(Vec a, Vec b) {
+        return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ);
+    }
+    static Vec blend(Mask m, Vec a, Vec b) {
+        return _mm512_mask_blend_pd(m, b, a);
+    }
+    static void store(double* p, Vec v) { _mm512_storeu_pd(p, v); }
+};
+
+/** Sixteen single-precision centroids at a time. */
+template<>
+struct Avx512Isa<float> {
+    using Vec  = __m512;
+    using Mask = __mmask16;
+    static constexpr int Width = 16;
+    static const char* name() { return "avx512"; }
+    static Vec load(const float* p) { return _mm512_loadu_ps(p); }
+    static Vec set1(const float v)  { return _mm512_set1_ps(v); }
+    static Vec iota() {
+        return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7,
+                              8, 9, 10, 11, 12, 13, 14, 15);
+    }
+    static Vec add(Vec a, Vec b)    { return _mm512_add_ps(a, b); }
+    static Vec sub(Vec a, Vec b)    { return _mm512_sub_ps(a, b); }
+    static Vec mul(Vec a, Vec b)    { return _mm512_mul_ps(a, b); }
+    static Vec fma(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+    static Mask less(Vec a, Vec b) {
+        return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+    }
+    static Vec blend(Mask m, Vec a, Vec b) {
+        return _mm512_mask_blend_ps(m, b, a);
+    }
+    static void store(float* p, Vec v) { _mm512_storeu_ps(p, v); }
+};
+template<typename Real>
+using NativeIsa = Avx512Isa<Real>;
+#elif defined(__AVX2__)
+template<typename Real>
+using NativeIsa = Avx2Isa<Real>;
+#else
+template<typename Real>
+using NativeIsa = ScalarIsa<Real>;
+#endif
+
+/**
+ * The kernel that finds the closest centroid for a block of up to
+ * BlockSize points.  Each iteration of the outer loop computes the
+ * squared distance from every point in the block to Isa::Width
+ * consecutive centroids.  Each lane keeps the best distance (and
+ * index) it has seen, and the lanes are combined at the end.
+ *
+ * \tparam Isa The instruction set to be used.
+ *
+ * \tparam Dim The number of dimensions, if known at compile time.
+ * Zero indicates that table.d is to be used.
+ */
+template<typename Real>
+template<typename Isa, int Dim>
+void
+BasicCentroidTable<Real>::nearestBlock(const BasicCentroidTable& table,
+                                       const Real* const pts[BlockSize],
+                                       const int count, int* idx,
+                                       Real* distSq) {
+    using Vec = typename Isa::Vec;
+    constexpr int Block = BlockSize;
+    const int dims = (Dim > 0) ? Dim : table.d;
+    const Real* const coords = table.coords.data();
+
+    // Per-point best distance and centroid index in each lane.
+    Vec best[Block], bestIdx[Block];
+    for (int p = 0; (p < Block); p++) {
+        best[p]    = Isa::set1(std::numeric_limits<Real>::infinity());
+        bestIdx[p] = Isa::set1(0);
+    }
+    Vec cIdx = Isa::iota();
+    const Vec step = Isa::set1(Isa::Width);
+    for (size_t c = 0; (c < table.stride); c += Isa::Width) {
+        Vec acc[Block];
+        for (int p = 0; (p < Block); p++) {
+            acc[p] = Isa::set1(0);
+        }
+        // Each coordinate of the centroids is loaded once and reused
+        // for all the points in the block.
+        for (int dim = 0; (dim < dims); dim++) {
+            const Vec cv = Isa::load(coords + dim * table.stride + c);
+            for (int p = 0; (p < Block); p++) {
+                const Vec diff = Isa::sub(Isa::set1(pts[p][dim]), cv);
+                acc[p] = Isa::add(acc[p], Isa::mul(diff, diff));
+            }
+        }
+        // Strictly-less comparison so that each lane retains the
+        // lowest centroid index among equally distant centroids.
+        for (int p = 0; (p < Block); p++) {
+            const auto closer = Isa::less(acc[p], best[p]);
+            best[p]    = Isa::blend(closer, acc[p], best[p]);
+            bestIdx[p] = Isa::blend(closer, cIdx, bestIdx[p]);
+        }
+        cIdx = Isa::add(cIdx, step);
+    }
+    // Reduce the lanes for each point to get the final result.
+    for (int p = 0; (p < count); p++) {
+        Real dist[Isa::Width], index[Isa::Width];
+        Isa::store(dist, best[p]);
+        Isa::store(index, bestIdx[p]);
+        int lane = 0;
+        for (int l = 1; (l < Isa::Width); l++) {
+            if ((dist[l] < dist[lane]) ||
+                ((dist[l] == dist[lane]) && (index[l] < index[lane]))) {
+                lane = l;
+            }
+        }
+        idx[p] = index[lane];
+        if (distSq != nullptr) {
+            distSq[p] = dist[lane];
+        }
+    }
+}
+
+/** The number of vectors of centroids in each step of nearestGemm(). */
+constexpr int GemmVecs = 4;
+
+/**
+ * The kernel used for points with many dimensions.  It expands the
+ * squared distance as |x - c|^2 = |x|^2 - 2 x.c + |c|^2, so that the
+ * distances from a block of points to all the centroids become one
+ * small matrix product (the block of points times the transposed
+ * centroids), computed with one fused multiply-add per coordinate
+ * instead of a subtract, multiply, and add.  |x|^2 is the same for
+ * all centroids and |c|^2 is computed when the centroids are loaded,
+ * so each centroid is ranked by |c|^2 - 2 x.c.
+ *
+ * The expansion suffers from cancellation when the points are far
+ * from the origin relative to their distances to the centroids.  To
+ * limit this, the points and centroids are shifted so that the mean
+ * of the centroids is the origin.  Even so, the ranking is only used
+ * to pick the candidates: every centroid whose score is within the
+ * worst-case rounding error of the best score has its distance
+ * computed directly (with the unshifted coordinates), and the closest
+ * of these (lowest index on ties) is returned.  Normally there is
+ * only one candidate, so the result is the same as that of
+ * nearestBlock() at little extra cost.
+ *
+ * \tparam Isa The instruction set to be used.
+ */
+template<typename Real>
+template<typename Isa>
+void
+BasicCentroidTable<Real>::nearestGemm(const BasicCentroidTable& table,
+                                      const Real* const pts[BlockSize],
+                                      const int count, int* idx,
+                                      Real* distSq) {
+    using Vec = typename Isa::Vec;
+    constexpr int Block = BlockSize;
+    const int dims = table.d;
+    const size_t stride = table.stride;
+    const Real* const coords = table.coords.data();
+    // The shifted points and their scores, for the candidate check.
+    thread_local std::vector<Real> shifted, scores;
+    shifted.resize(Block * dims);
+    scores.resize(Block * stride);
+    Real normSq[Block] = {};
+    for (int dim = 0; (dim < dims); dim++) {
+        for (int p = 0; (p < Block); p++) {
+            const Real x = pts[p][dim] - table.center[dim];
+            shifted[p * dims + dim] = x;
+            normSq[p] += x * x;
+        }
+    }
+
+    // Each step covers GemmVecs vectors of centroids, so that there
+    // are enough independent multiply-adds to hide their latency.
+    constexpr int Vecs = GemmVecs;
+    Vec best[Block], bestIdx[Block];
+    for (int p = 0; (p < Block); p++) {
+        best[p]    = Isa::set1(std::numeric_limits<Real>::infinity());
+        bestIdx[p] = Isa::set1(0);
+    }
+    const Vec minus2 = Isa::set1(-2), step = Isa::set1(Isa::Width);
+    Vec cIdx = Isa::iota();
+    for (size_t c = 0; (c < stride); c += Vecs * Isa::Width) {
+        Vec dot[Block][Vecs];
+        for (int p = 0; (p < Block); p++) {
+            for (int v = 0; (v < Vecs); v++) {
+                dot[p][v] = Isa::set1(0);
+            }
+        }
+        for (int dim = 0; (dim < dims); dim++) {
+            Vec cv[Vecs];
+            for (int v = 0; (v < Vecs); v++) {
+                cv[v] = Isa::load(coords + dim * stride + c + v * Isa::Width);
+            }
+            for (int p = 0; (p < Block); p++) {
+                const Vec xv = Isa::set1(shifted[p * dims + dim]);
+                for (int v = 0; (v < Vecs); v++) {
+                    dot[p][v] = Isa::fma(xv, cv[v], dot[p][v]);
+                }
+            }
+        }
+        for (int v = 0; (v < Vecs); v++) {
+            const size_t cv = c + v * Isa::Width;
+            const Vec norm  = Isa::load(table.norms.data() + cv);
+            for (int p = 0; (p < Block); p++) {
+                const Vec score = Isa::fma(minus2, dot[p][v], norm);
+                Isa::store(scores.data() + p * stride + cv, score);
+                const auto closer = Isa::less(score, best[p]);
+                best[p]    = Isa::blend(closer, score, best[p]);
+                bestIdx[p] = Isa::blend(closer, cIdx, bestIdx[p]);
+            }
+            cIdx = Isa::add(cIdx, step);
+        }
+    }
+
+    // An upper bound on the rounding error of x.c (dims products and
+    // sums) and of the remaining terms, relative to (|x| + |c|)^2.
+    const Real eps = (dims + 4) * std::numeric_limits<Real>::epsilon();
+    for (int p = 0; (p < count); p++) {
+        Real dist[Isa::Width], index[Isa::Width];
+        Isa::store(dist, best[p]);
+        Isa::store(index, bestIdx[p]);
+        int lane = 0;
+        for (int l = 1; (l < Isa::Width); l++) {
+            if ((dist[l] < dist[lane]) ||
+                ((dist[l] == dist[lane]) && (index[l] < index[lane]))) {
+                lane = l;
+            }
+        }
+        int bestC = index[lane];
+        const Real bound = std::sqrt(normSq[p]) + table.maxNorm;
+        const Real limit = dist[lane] + 2 * eps * bound * bound;
+        // Count the candidates (a loop the compiler vectorizes).
+        const Real* const score = scores.data() + p * stride;
+        int candidates = 0;
+        for (size_t c = 0; (c < stride); c++) {
+            candidates += (score[c] <= limit);
+        }
+        if ((candidates == 1) && (distSq == nullptr)) {
+            idx[p] = bestC;
+            continue;
+        }
+        // Compute the distance directly for each candidate.
+        auto distance = [&](const int c) {
+            const Real* const cent = table.rows.data() + c * dims;
+            Real sum = 0;
+            for (int dim = 0; (dim < dims); dim++) {
+                const Real diff = pts[p][dim] - cent[dim];
+                sum += diff * diff;
+            }
+            return sum;
+        };
+        Real bestDist = distance(bestC);
+        for (int c = 0; (c < table.k) && (candidates > 1); c++) {
+            if ((c != bestC) && (score[c] <= limit)) {
+                const Real cDist = distance(c);
+                if ((cDist < bestDist) ||
+                    ((cDist == bestDist) && (c < bestC))) {
+                    bestDist = cDist;
+                    bestC    = c;
+                }
+            }
+        }
+        idx[p] = bestC;
+        if (distSq != nullptr) {
+            distSq[p] = bestDist;
+        }
+    }
+}
+
+template<typename Real>
+BasicCentroidTable<Real>::BasicCentroidTable(const PointList& centroids) {
+    load(centroids);
+}
+
+template<typename Real>
+void
+BasicCentroidTable<Real>::load(const PointList& centroids) {
+    k = centroids.size();
+    d = (k > 0) ? centroids.front().size() : 0;
+    // The matrix-product kernel works on GemmVecs vectors at a time,
+    // so it is only used when that does not add much padding.
+    const bool gemm = (d >= GemmDims) &&
+        (k >= GemmVecs * NativeIsa<Real>::Width);
+    // Round the number of centroids up to the SIMD width.
+    const int Width = NativeIsa<Real>::Width * (gemm ? GemmVecs : 1);
+    stride = (k + Width - 1) / Width * Width;
+    if (!gemm) {
+        // The padding entries are at infinity so they are never closest.
+        coords.assign(d * stride, std::numeric_limits<Real>::infinity());
+        for (int c = 0; (c < k); c++) {
+            for (int dim = 0; (dim < d); dim++) {
+                coords[dim * stride + c] = centroids[c][dim];
+            }
+        }
+    } else {
+        loadGemm(centroids);
+    }
+    // Use the specialized kernels for the common (low) dimensions.
+    switch (d) {
+    case 2:  kernel = nearestBlock<NativeIsa<Real>, 2>; break;
+    case 4:  kernel = nearestBlock<NativeIsa<Real>, 4>; break;
+    default: kernel = gemm ? nearestGemm<NativeIsa<Real>> :
+                             nearestBlock<NativeIsa<Real>, 0>;
+    }
+}
+
+template<typename Real>
+void
+BasicCentroidTable<Real>::loadGemm(const PointList& centroids) {
+    // Shift the origin to the mean of the centroids.
+    center.assign(d, 0);
+    for (int dim = 0; (dim < d); dim++) {
+        double sum = 0;
+        for (int c = 0; (c < k); c++) {
+            sum += centroids[c][dim];
+        }
+        center[dim] = sum / k;
+    }
+    // The padding entries are at the origin with an infinite norm, so
+    // that their score is infinite (infinity times 0 would be NaN).
+    coords.assign(d * stride, 0);
+    norms.assign(stride, std::numeric_limits<Real>::infinity());
+    rows.resize(k * d);
+    maxNorm = 0;
+    for (int c = 0; (c < k); c++) {
+        norms[c] = 0;
+        for (int dim = 0; (dim < d); dim++) {
+            rows[c * d + dim] = centroids[c][dim];
+            const Real x = rows[c * d + dim] - center[dim];
+            coords[dim * stride + c] = x;
+            norms[c] += x * x;
+        }
+        maxNorm = std::max<Real>(maxNorm, std::sqrt(norms[c]));
+    }
+}
+
+template<typename Real>
+int
+BasicCentroidTable<Real>::nearest(const Real* pt, Real* distSq) const {
+    // Use the same point for all entries in the block.
+    const Real* pts[BlockSize];
+    std::fill_n(pts, BlockSize, pt);
+    int idx;
+    kernel(*this, pts, 1, &idx, distSq);
+    return idx;
+}
+
+template<typename Real>
+void
+BasicCentroidTable<Real>::nearest(const BasicPointArray<Real>& points,
+                                  size_t begin, size_t end, int* idx,
+                                  Real* distSq) const {
+    const Real* pts[BlockSize];
+    for (size_t i = begin; (i < end); i += BlockSize) {
+        const int count = std::min<size_t>(BlockSize, end - i);
+        // Fill up the block.  A partial block at the end repeats the
+        // last point so that the kernel does not need a special case.
+        for (int p = 0; (p < BlockSize); p++) {
+            pts[p] = points[i + std::min(p, count - 1)];
+        }
+        kernel(*this, pts, count, idx + (i - begin),
+               (distSq != nullptr) ? distSq + (i - begin) : nullptr);
+    }
+}
+
+template<typename Real>
+const char*
+BasicCentroidTable<Real>::isa() {
+    return NativeIsa<Real>::name();
+}
+
+// The tables for the supported precisions.
+template class BasicCentroidTable<double>;
+template class BasicCentroidTable<float>;
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef CENTROID_TABLE_H
+#define CENTROID_TABLE_H
+
+/**
+ * The nearest-centroid (assignment) kernel used by k-means.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+
+/**
+ * A copy of the current centroids laid out for fast nearest-centroid
+ * searches.
+ *
+ * The centroids are stored transposed (dimension-major): all the
+ * first coordinates, then all the second coordinates, and so on.
+ * Each dimension is padded to a multiple of the SIMD width so that a
+ * vector register holds the same coordinate of several consecutive
+ * centroids.  The padding entries are set to infinity so that they
+ * are never selected as the nearest centroid.
+ *
+ * The search compares squared distances (no sqrt) and ties are
+ * broken in favor of the lower centroid index, just as a linear scan
+ * would.  The kernel is selected when the centroids are loaded: it
+ * is specialized at compile time for 2-D and 4-D points and uses
+ * AVX-512 or AVX2 when the program is compiled for such a CPU (for
+ * example, with -march=native).  Otherwise a portable scalar version
+ * is used.  With GemmDims or more dimensions (and enough centroids
+ * to fill its register tile), the distances are instead expanded into
+ * a small matrix product, which needs about a third of the arithmetic
+ * (see nearestGemm() in CentroidTable.cpp).
+ *
+ * \tparam Real The precision of the points and of the distance
+ * computations.  With float, each SIMD register holds twice as many
+ * centroids.  The methods are defined in CentroidTable.cpp for
+ * double (CentroidTable) and float (CentroidTableF).
+ */
+template<typename Real>
+class BasicCentroidTable {
+public:
+    /**
+     * The number of points that are processed together by the
+     * kernel.  Each vector of centroid coordinates loaded from memory
+     * is reused for these many points.
+     */
+    static constexpr int BlockSize = 4;
+
+    /**
+     * The number of dimensions from which the distances are computed
+     * as a matrix product, which is faster than the direct kernel
+     * once the dot products dominate the cost of a search.
+     */
+    static constexpr int GemmDims = 16;
+
+    /**
+     * Creates a table for a given set of centroids.
+     *
+     * \param[in] centroids The centroids to be copied into this
+     * table.  All centroids must have the same dimensions.
+     */
+    explicit BasicCentroidTable(const PointList& centroids = {});
+
+    /**
+     * Replaces the centroids in this table with a new set of
+     * centroids, converted to Real.  The memory in the table is
+     * reused if the number of centroids and dimensions do not change.
+     *
+     * \param[in] centroids The new centroids to be used.
+     */
+    void load(const PointList& centroids);
+
+    /**
+     * Returns the number of centroids in this table.
+     */
+    int size() const { return k; }
+
+    /**
+     * Returns the number of dimensions of each centroid.
+     */
+    int dims() const { return d; }
+
+    /**
+     * Finds the centroid closest to a given point.
+     *
+     * \param[in] pt Pointer to the dims() coordinates of the point.
+     *
+     * \param[out] distSq If not null, the squared distance to the
+     * closest centroid is stored here.
+     *
+     * \return The index of the closest centroid.
+     */
+    int nearest(const Real* pt, Real* distSq = nullptr) const;
+
+    /**
+     * Finds the closest centroid for each point in a range of
+     * points.  The points are processed in blocks of BlockSize.
+     *
+     * \param[in] points The points to be assigned to centroids.
+     *
+     * \param[in] begin Index of the first point to be assigned.
+     *
+     * \param[in] end Index one past the last point to be assigned.
+     *
+     * \param[out] idx The index of the closest centroid for point i
+     * is stored in idx[i - begin].
+     *
+     * \param[out] distSq If not null, the squared distance of point i
+     * to its closest centroid is stored in distSq[i - begin].
+     */
+    void nearest(const BasicPointArray<Real>& points, size_t begin,
+                 size_t end, int* idx, Real* distSq = nullptr) const;
+
+    /**
+     * Returns the name of the instruction set used by the kernel
+     * ("avx512", "avx2", or "scalar").  This is handy to confirm
+     * which code path a given build is using.
+     */
+    static const char* isa();
+
+    /**
+     * The signature of the kernel that finds the closest centroids
+     * for a block of up to BlockSize points.
+     */
+    using Kernel = void (*)(const BasicCentroidTable& table,
+                            const Real* const pts[BlockSize],
+                            const int count, int* idx, Real* distSq);
+
+private:
+    /// The number of centroids.
+    int k = 0;
+    /// The number of dimensions of each centroid.
+    int d = 0;
+    /// The number of entries for each dimension (k padded to the
+    /// SIMD width).
+    size_t stride = 0;
+    /// The transposed centroid coordinates, d * stride entries.
+    /// For the matrix-product kernel, they are relative to center.
+    std::vector<Real> coords;
+
+    // The following are only used by the matrix-product kernel.
+
+    /// The mean of the centroids, d entries.
+    std::vector<Real> center;
+    /// The squared norm of each (shifted) centroid, stride entries.
+    std::vector<Real> norms;
+    /// The largest norm (not squared) of the shifted centroids.
+    Real maxNorm = 0;
+    /// The centroids, unshifted and not transposed, k * d entries.
+    std::vector<Real> rows;
+    /// The kernel specialized for the dimensions of the centroids.
+    Kernel kernel = nullptr;
+
+    /**
+     * The kernels, for each instruction set and number of dimensions.
+     * See CentroidTable.cpp.
+     */
+    template<typename Isa, int Dim>
+    static void nearestBlock(const BasicCentroidTable& table,
+                             const Real* const pts[BlockSize],
+                             const int count, int* idx, Real* distSq);
+
+    /**
+     * Sets up the centroids for the matrix-product kernel.  Called
+     * by load() after it has set k, d, and stride.
+     *
+     * \param[in] centroids The centroids to be loaded.
+     */
+    void loadGemm(const PointList& centroids);
+
+    /**
+     * The kernel that computes the distances as a matrix product,
+     * for each instruction set.  See CentroidTable.cpp.
+     */
+    template<typename Isa>
+    static void nearestGemm(const BasicCentroidTable& table,
+                            const Real* const pts[BlockSize],
+                            const int count, int* idx, Real* distSq);
+};
+
+/** The table used with double precision points. */
+using CentroidTable = BasicCentroidTable<double>;
+
+/** The table used with single precision points. */
+using CentroidTableF = BasicCentroidTable<float>;
+
+#endif
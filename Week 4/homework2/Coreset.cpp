@@ -0,0 +1,149 @@
+#ifndef CORESET_CPP
+#define CORESET_CPP
+
+/**
+ * Building and clustering coresets.  See Coreset.h for details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "Coreset.h"
+#include "CentroidTable.h"
+
+template<typename Real>
+Coreset buildCoreset(const BasicPointArray<Real>& data,
+                     const int numCentroids, const CoresetOptions& opts) {
+    const long n = data.size();
+    const int dims = data.dims();
+    // Pick the points to be used and count how many times each is drawn.
+    std::vector<std::pair<long, double>> picked;
+    if (size_t(n) <= opts.size) {
+        for (long i = 0; (i < n); i++) {
+            picked.push_back({i, 1});
+        }
+    } else {
+        // The rough solution and the closest center of each point.
+        SeedOptions seeding;
+        seeding.seed    = opts.seed;
+        seeding.threads = opts.threads;
+        const BasicCentroidTable<Real> table(kmeansPlusPlus(data,
+                                                            numCentroids,
+                                                            seeding));
+        IntVec idx(n);
+        std::vector<Real> distSq(n);
+        constexpr long Chunk = 4096;
+        #pragma omp parallel for schedule(static) \
+            num_threads(threadCount(LloydOptions{0, opts.threads}))
+        for (long begin = 0; begin < n; begin += Chunk) {
+            table.nearest(data, begin, std::min(begin + Chunk, n),
+                          &idx[begin], &distSq[begin]);
+        }
+        // The cost and size of each cluster.
+        std::vector<double> cost(table.size(), 0);
+        std::vector<long> size(table.size(), 0);
+        double total = 0;
+        for (long i = 0; (i < n); i++) {
+            cost[idx[i]] += distSq[i];
+            size[idx[i]]++;
+            total += distSq[i];
+        }
+        // The sensitivity of each point.  If every point is at its
+        // center (total is 0), only the cluster sizes matter.
+        const double alpha = 16 * (std::log(table.size()) + 2);
+        const double meanCost = (total > 0) ? total / n : 1;
+        std::vector<double> sensitivity(n);
+        for (long i = 0; (i < n); i++) {
+            const int b = idx[i];
+            sensitivity[i] = alpha * distSq[i] / meanCost +
+                2 * alpha * cost[b] / (size[b] * meanCost) +
+                4.0 * n / size[b];
+        }
+        double sumSens = 0;
+        for (long i = 0; (i < n); i++) {
+            sumSens += sensitivity[i];
+        }
+        // Draw the points and merge the ones drawn more than once.
+        std::mt19937_64 rng(opts.seed);
+        std::discrete_distribution<long> draw(sensitivity.begin(),
+                                              sensitivity.end());
+        std::vector<long> drawn(opts.size);
+        for (auto& i : drawn) {
+            i = draw(rng);
+        }
+        std::sort(drawn.begin(), drawn.end());
+        for (size_t j = 0; (j < drawn.size()); j++) {
+            // Each draw of point i carries a weight of 1 / (m q(i)).
+            const double weight = sumSens / (opts.size *
+                                             sensitivity[drawn[j]]);
+            if (!picked.empty() && (picked.back().first == drawn[j])) {
+                picked.back().second += weight;
+            } else {
+                picked.push_back({drawn[j], weight});
+            }
+        }
+    }
+    // Copy the picked points into the coreset.
+    Coreset coreset;
+    coreset.points = PointArray(picked.size(), dims);
+    coreset.weights.resize(picked.size());
+    for (size_t j = 0; (j < picked.size()); j++) {
+        std::copy_n(data[picked[j].first], dims, coreset.points[j]);
+        coreset.weights[j] = picked[j].second;
+    }
+    return coreset;
+}
+
+// The versions of buildCoreset() for the supported precisions.
+template Coreset buildCoreset(const PointArray&, const int,
+                              const CoresetOptions&);
+template Coreset buildCoreset(const PointArrayF&, const int,
+                              const CoresetOptions&);
+
+IntVec weightedKmeans(const Coreset& coreset, PointList& centroids,
+                      const LloydOptions& opts, int* iterations) {
+    const PointArray& points = coreset.points;
+    IntVec clsIdx(points.size(), -1);
+    CentroidTable table;
+    CentroidSums sums;
+    int iteration = 0;
+    while (iteration < opts.maxIterations) {
+        // assign each point and add its weighted coordinates to the
+        // sums for its centroid
+        table.load(centroids);
+        sums.reset(table.size(), table.dims());
+        long changed = 0;
+        reduceRanges(points.size(), sums, opts,
+                     [&](size_t begin, size_t end, CentroidSums& local) {
+            IntVec idx(end - begin);
+            table.nearest(points, begin, end, idx.data());
+            long moved = 0;
+            for (size_t i = begin; (i < end); i++) {
+                const int c = idx[i - begin];
+                moved += (c != clsIdx[i]);
+                clsIdx[i] = c;
+                local.addWeighted(c, points[i], coreset.weights[i]);
+            }
+            #pragma omp atomic
+            changed += moved;
+            return long(end - begin) * table.size();
+        });
+        iteration++;
+        // move each centroid to the weighted mean of its points
+        const PointList prevCentroids = centroids;
+        for (size_t c = 0; (c < centroids.size()); c++) {
+            sums.computeWeightedCentroid(c, centroids[c]);
+        }
+        if (converged(prevCentroids, centroids, changed, opts)) {
+            break;
+        }
+    }
+    if (iterations != nullptr) {
+        *iterations = iteration;
+    }
+    return clsIdx;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef CORESET_H
+#define CORESET_H
+
+/**
+ * Coresets: a small set of weighted points that stands in for a large
+ * set of points when clustering.  The k-means cost of any set of
+ * centroids on the coreset (with each distance multiplied by the
+ * weight of its point) is close to the cost on all the points, so the
+ * Lloyd iterations can be run on the coreset and the points only need
+ * to be read a few times.
+ *
+ * The coreset is built by sensitivity sampling ("Practical Coreset
+ * Constructions for Machine Learning", Bachem, Lucic, and Krause,
+ * 2017).  A rough solution B is computed with k-means++ seeding.  Each
+ * point x, closest to the center b in B, is then given a sensitivity
+ *
+ *   s(x) = a d(x)^2 / c + 2 a cost(b) / (|b| c) + 4 n / |b|
+ *
+ * where d(x) is the distance of x to b, cost(b) and |b| are the sum
+ * of d^2 and the number of points closest to b, c is the mean of d^2
+ * over all n points, and a = 16 (ln k + 2).  Points far from their
+ * center, or in small clusters, have a high sensitivity.  m points
+ * are drawn (with replacement) with probability q(x) = s(x) / sum(s)
+ * and each is weighted by 1 / (m q(x)), so the weights of the coreset
+ * add up to about n.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+#include "Seeding.h"
+
+/**
+ * The options that control how a coreset is built.
+ */
+struct CoresetOptions {
+    /// The number of points drawn.  Points drawn more than once are
+    /// merged, so the coreset may have fewer points.
+    size_t size = 1000;
+
+    /// The seed for the k-means++ solution and for drawing the points.
+    unsigned seed = std::default_random_engine::default_seed;
+
+    /// The number of threads to be used. Zero uses the OpenMP default.
+    int threads = 0;
+};
+
+/**
+ * A set of weighted points.
+ */
+struct Coreset {
+    /// The points, in the order in which they appear in the data.
+    PointArray points;
+    /// The weight of each point.
+    std::vector<double> weights;
+};
+
+/**
+ * Builds a coreset for k-means clustering by sensitivity sampling.
+ * It is defined for PointArray and PointArrayF points; the coreset is
+ * always in double.
+ *
+ * \param[in] data The points to be compressed.
+ *
+ * \param[in] numCentroids The number of centroids that will be used
+ * to cluster the coreset.
+ *
+ * \param[in] opts The options controlling the coreset.
+ *
+ * \return The coreset.  If data has at most opts.size points, all of
+ * the points are returned with a weight of 1.
+ */
+template<typename Real>
+Coreset buildCoreset(const BasicPointArray<Real>& data,
+                     const int numCentroids,
+                     const CoresetOptions& opts = {});
+
+/**
+ * Runs weighted Lloyd iterations: each centroid is moved to the
+ * weighted mean of its points (see CentroidSums::addWeighted()).  The
+ * iterations stop as described in converged().
+ *
+ * \param[in] coreset The weighted points to be clustered.
+ *
+ * \param[in,out] centroids The initial centroids.  They are updated
+ * to the final centroids.
+ *
+ * \param[in] opts The options controlling the iterations.  The accel
+ * option is ignored.
+ *
+ * \param[out] iterations If not null, the number of iterations run
+ * is stored here.
+ *
+ * \return The index of the centroid closest to each point in the
+ * coreset.
+ */
+IntVec weightedKmeans(const Coreset& coreset, PointList& centroids,
+                      const LloydOptions& opts = {},
+                      int* iterations = nullptr);
+
+#endif
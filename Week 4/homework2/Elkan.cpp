@@ -0,0 +1,345 @@
+#ifndef ELKAN_CPP
+#define ELKAN_CPP
+
+/**
+ * Triangle-inequality accelerated k-means (Elkan's and Hamerly's
+ * algorithms).  See Elkan.h for an overview.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include "Elkan.h"
+
+// The final decision to switch a point to another centroid compares
+// squared distances and breaks ties in favor of the lower index, just
+// like CentroidTable.  The bounds are only used to skip work, and a
+// point is skipped only when a bound is strictly better.  This keeps
+// the assignments identical to the plain Lloyd iterations.  Like
+// lloydUpdate() in Lloyd.h, after the first iteration only the points
+// that changed centroids are moved between the sums.
+
+/**
+ * Helper method to record the assignment of a point in the sums.
+ * In the first iteration the point is added to the sums.  Later, it
+ * is moved between the sums only if its centroid changed.
+ *
+ * \param[in,out] local The sums (or changes to them) being computed.
+ *
+ * \param[in] first True if this is the first iteration.
+ *
+ * \param[in] prev The centroid the point was assigned to before.
+ *
+ * \param[in] c The centroid the point is assigned to now.
+ *
+ * \param[in] pt The coordinates of the point.
+ *
+ * \return 1 if the point changed centroids, 0 otherwise.
+ */
+static long reassign(CentroidSums& local, const bool first, const int prev,
+                     const int c, const double* pt) {
+    if (first) {
+        local.add(c, pt);
+    } else if (c != prev) {
+        local.remove(prev, pt);
+        local.add(c, pt);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Computes the squared distance between two points.
+ *
+ * \param[in] p1 The coordinates of the first point.
+ *
+ * \param[in] p2 The coordinates of the second point.
+ *
+ * \param[in] dims The number of coordinates in each point.
+ */
+static double distSq(const double* p1, const double* p2, const int dims) {
+    double sum = 0;
+    for (int i = 0; (i < dims); i++) {
+        const double diff = p1[i] - p2[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+/**
+ * Computes half the distance between every pair of centroids and,
+ * for each centroid, half the distance to its closest other centroid.
+ * A point that is within s[c] of its centroid c cannot be closer to
+ * any other centroid.
+ *
+ * \param[in] centroids The current centroids.
+ *
+ * \param[out] half The k * k matrix of half distances (only filled in
+ * when not null).
+ *
+ * \param[out] s The half distance to the closest other centroid.
+ */
+static void halfSeparations(const PointList& centroids,
+                            std::vector<double>* half,
+                            std::vector<double>& s) {
+    const int k = centroids.size(), dims = centroids.front().size();
+    s.assign(k, std::numeric_limits<double>::infinity());
+    for (int i = 0; (i < k); i++) {
+        for (int j = i + 1; (j < k); j++) {
+            const double dist = 0.5 * std::sqrt(distSq(&centroids[i][0],
+                                                       &centroids[j][0], dims));
+            if (half != nullptr) {
+                (*half)[i * k + j] = (*half)[j * k + i] = dist;
+            }
+            s[i] = std::min(s[i], dist);
+            s[j] = std::min(s[j], dist);
+        }
+    }
+}
+
+/**
+ * Moves each centroid to the mean of its points and records how far
+ * each centroid moved.
+ *
+ * \param[in] sums The per-centroid sums from the assignment pass.
+ *
+ * \param[in,out] centroids The centroids to be updated.
+ *
+ * \param[out] moves The distance each centroid moved.
+ *
+ * \param[in] changed The number of points assigned to a different
+ * centroid in this iteration.
+ *
+ * \param[in] opts The convergence tolerances.
+ *
+ * \return true if the iterations have converged.
+ */
+static bool moveCentroids(const CentroidSums& sums, PointList& centroids,
+                          std::vector<double>& moves, const long changed,
+                          const LloydOptions& opts) {
+    const PointList prevCentroids = centroids;
+    const int dims = centroids.front().size();
+    moves.resize(centroids.size());
+    for (size_t c = 0; (c < centroids.size()); c++) {
+        sums.computeNewCentroid(c, centroids[c]);
+        moves[c] = std::sqrt(distSq(&prevCentroids[c][0], &centroids[c][0],
+                                    dims));
+    }
+    return converged(prevCentroids, centroids, changed, opts);
+}
+
+/**
+ * Helper method to compute the distance from a point to every
+ * centroid and return the closest one.  This is used for the first
+ * iteration of both algorithms and by Hamerly's algorithm when its
+ * bounds fail.
+ *
+ * \param[in] pt The coordinates of the point.
+ *
+ * \param[in] centroids The current centroids.
+ *
+ * \param[out] dists If not null, the distance to each centroid.
+ *
+ * \param[out] best The distance to the closest centroid.
+ *
+ * \param[out] second The distance to the second-closest centroid.
+ *
+ * \return The index of the closest centroid.
+ */
+static int scanAll(const double* pt, const PointList& centroids,
+                   double* dists, double& best, double& second) {
+    const int dims = centroids.front().size();
+    double bestSq = std::numeric_limits<double>::infinity();
+    double secondSq = bestSq;
+    int closest = 0;
+    for (size_t c = 0; (c < centroids.size()); c++) {
+        const double dSq = distSq(pt, &centroids[c][0], dims);
+        if (dists != nullptr) {
+            dists[c] = std::sqrt(dSq);
+        }
+        if (dSq < bestSq) {
+            secondSq = bestSq;
+            bestSq   = dSq;
+            closest  = c;
+        } else if (dSq < secondSq) {
+            secondSq = dSq;
+        }
+    }
+    best   = std::sqrt(bestSq);
+    second = std::sqrt(secondSq);
+    return closest;
+}
+
+IntVec elkanKmeans(const PointArray& points, PointList& centroids,
+                   const LloydOptions& opts, int* iterations,
+                   long* distCount) {
+    const size_t n = points.size();
+    const int k = centroids.size(), dims = points.dims();
+    IntVec centIdx(n);
+    // The upper bound for each point and the k lower bounds.  Rather
+    // than loosening all n * k lower bounds after every iteration,
+    // each lower bound is stored with the total distance its centroid
+    // had moved (drift) when it was set.  The current lower bound is
+    // then the stored value minus the current drift.
+    std::vector<double> upper(n), lower(n * k), drift(k, 0);
+    std::vector<double> half(k * k), s, moves;
+    CentroidSums sums(k, dims), delta;
+    long distances = 0;
+    int iteration = 0;
+    while (iteration < opts.maxIterations) {
+        halfSeparations(centroids, &half, s);
+        delta.reset(k, dims);
+        long changed = (iteration == 0) ? n : 0;
+        distances += reduceRanges(n, (iteration == 0) ? sums : delta, opts,
+                                  [&](size_t begin, size_t end,
+                                      CentroidSums& local) {
+            long count = 0, moved = 0;
+            for (size_t i = begin; (i < end); i++) {
+                const double* pt = points[i];
+                const int prev = centIdx[i];
+                double* lb = &lower[i * k];
+                if (iteration == 0) {
+                    // The first iteration computes all the distances.
+                    double second;
+                    centIdx[i] = scanAll(pt, centroids, lb, upper[i], second);
+                    count += k;
+                } else if (upper[i] >= s[centIdx[i]]) {
+                    int a = centIdx[i];
+                    double u = upper[i], uSq = 0;
+                    bool tight = false;
+                    for (int j = 0; (j < k); j++) {
+                        if ((j == a) || (u < lb[j] - drift[j]) ||
+                            (u < half[a * k + j])) {
+                            continue;
+                        }
+                        if (!tight) {
+                            // Tighten the upper bound and check again.
+                            uSq   = distSq(pt, &centroids[a][0], dims);
+                            u     = std::sqrt(uSq);
+                            lb[a] = u + drift[a];
+                            tight = true;
+                            count++;
+                            if ((u < lb[j] - drift[j]) ||
+                                (u < half[a * k + j])) {
+                                continue;
+                            }
+                        }
+                        const double dSq = distSq(pt, &centroids[j][0], dims);
+                        const double dist = std::sqrt(dSq);
+                        lb[j] = dist + drift[j];
+                        count++;
+                        if ((dSq < uSq) || ((dSq == uSq) && (j < a))) {
+                            a = j;
+                            u = dist;
+                            uSq = dSq;
+                        }
+                    }
+                    centIdx[i] = a;
+                    upper[i]   = u;
+                }
+                moved += reassign(local, iteration == 0, prev, centIdx[i], pt);
+            }
+            #pragma omp atomic
+            changed += moved;
+            return count;
+        });
+        sums.merge(delta);
+        iteration++;
+        if (moveCentroids(sums, centroids, moves, changed, opts)) {
+            break;
+        }
+        // Loosen the bounds by the distance each centroid moved.
+        for (int j = 0; (j < k); j++) {
+            drift[j] += moves[j];
+        }
+        #pragma omp parallel for num_threads(threadCount(opts))
+        for (size_t i = 0; i < n; i++) {
+            upper[i] += moves[centIdx[i]];
+        }
+    }
+    if (iterations != nullptr) {
+        *iterations = iteration;
+    }
+    if (distCount != nullptr) {
+        *distCount = distances;
+    }
+    return centIdx;
+}
+
+IntVec hamerlyKmeans(const PointArray& points, PointList& centroids,
+                     const LloydOptions& opts, int* iterations,
+                     long* distCount) {
+    const size_t n = points.size();
+    const int k = centroids.size(), dims = points.dims();
+    IntVec centIdx(n);
+    // The upper bound and a single lower bound for each point.
+    std::vector<double> upper(n), lower(n), s, moves;
+    CentroidSums sums(k, dims), delta;
+    long distances = 0;
+    int iteration = 0;
+    while (iteration < opts.maxIterations) {
+        halfSeparations(centroids, nullptr, s);
+        delta.reset(k, dims);
+        long changed = (iteration == 0) ? n : 0;
+        distances += reduceRanges(n, (iteration == 0) ? sums : delta, opts,
+                                  [&](size_t begin, size_t end,
+                                      CentroidSums& local) {
+            long count = 0, moved = 0;
+            for (size_t i = begin; (i < end); i++) {
+                const double* pt = points[i];
+                const int a = centIdx[i];
+                const double bound = std::max(s[a], lower[i]);
+                if ((iteration == 0) || (upper[i] >= bound)) {
+                    // Tighten the upper bound; if the bound still
+                    // fails, scan all the centroids.
+                    if (iteration > 0) {
+                        upper[i] = std::sqrt(distSq(pt, &centroids[a][0],
+                                                    dims));
+                        count++;
+                    }
+                    if ((iteration == 0) || (upper[i] >= bound)) {
+                        centIdx[i] = scanAll(pt, centroids, nullptr,
+                                             upper[i], lower[i]);
+                        count += k;
+                    }
+                }
+                moved += reassign(local, iteration == 0, a, centIdx[i], pt);
+            }
+            #pragma omp atomic
+            changed += moved;
+            return count;
+        });
+        sums.merge(delta);
+        iteration++;
+        if (moveCentroids(sums, centroids, moves, changed, opts)) {
+            break;
+        }
+        // Loosen the bounds.  The lower bound moves by the largest
+        // movement of any centroid other than the assigned one.
+        const auto maxIt = std::max_element(moves.begin(), moves.end());
+        const int maxIdx = maxIt - moves.begin();
+        double secondMax = 0;
+        for (int c = 0; (c < k); c++) {
+            if (c != maxIdx) {
+                secondMax = std::max(secondMax, moves[c]);
+            }
+        }
+        #pragma omp parallel for num_threads(threadCount(opts))
+        for (size_t i = 0; i < n; i++) {
+            upper[i] += moves[centIdx[i]];
+            lower[i] -= (centIdx[i] == maxIdx) ? secondMax : *maxIt;
+        }
+    }
+    if (iterations != nullptr) {
+        *iterations = iteration;
+    }
+    if (distCount != nullptr) {
+        *distCount = distances;
+    }
+    return centIdx;
+}
+
+#endif
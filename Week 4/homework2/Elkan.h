@@ -0,0 +1,77 @@
+#ifndef ELKAN_H
+#define ELKAN_H
+
+/**
+ * Triangle-inequality accelerated k-means (Elkan's and Hamerly's
+ * algorithms).
+ *
+ * Both algorithms produce the same centroids and assignments as the
+ * plain Lloyd iterations in Lloyd.h, but skip distance computations
+ * that provably cannot change the centroid assigned to a point.  For
+ * each point they keep an upper bound on the distance to its assigned
+ * centroid and lower bound(s) on the distances to the other
+ * centroids.  The bounds are loosened by the distance each centroid
+ * moves in an iteration:
+ *
+ *   - Elkan keeps one lower bound per point and centroid (n * k
+ *     doubles) along with the distances between centroids.  It skips
+ *     the most distances and suits larger k.
+ *
+ *   - Hamerly keeps a single lower bound per point (the distance to
+ *     the second-closest centroid).  It uses much less memory and
+ *     suits small k or low dimensions.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+
+/**
+ * Runs k-means using Elkan's algorithm.  The parameters are the same
+ * as setClosestCentroid() in Lloyd.h.
+ *
+ * \param[in] points The points being clustered.
+ *
+ * \param[in,out] centroids The initial centroids.  They are updated
+ * to the final centroids.
+ *
+ * \param[in] opts The options controlling the iterations.
+ *
+ * \param[out] iterations If not null, the number of iterations run
+ * is stored here.
+ *
+ * \param[out] distCount If not null, the number of point-centroid
+ * distances computed is stored here.
+ *
+ * \return The index of the centroid closest to each corresponding point.
+ */
+IntVec elkanKmeans(const PointArray& points, PointList& centroids,
+                   const LloydOptions& opts = {}, int* iterations = nullptr,
+                   long* distCount = nullptr);
+
+/**
+ * Runs k-means using Hamerly's algorithm.  The parameters are the
+ * same as setClosestCentroid() in Lloyd.h.
+ *
+ * \param[in] points The points being clustered.
+ *
+ * \param[in,out] centroids The initial centroids.  They are updated
+ * to the final centroids.
+ *
+ * \param[in] opts The options controlling the iterations.
+ *
+ * \param[out] iterations If not null, the number of iterations run
+ * is stored here.
+ *
+ * \param[out] distCount If not null, the number of point-centroid
+ * distances computed is stored here.
+ *
+ * \return The index of the centroid closest to each corresponding point.
+ */
+IntVec hamerlyKmeans(const PointArray& points, PointList& centroids,
+                     const LloydOptions& opts = {}, int* iterations = nullptr,
+                     long* distCount = nullptr);
+
+#endif
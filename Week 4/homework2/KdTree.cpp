@@ -0,0 +1,281 @@
+#ifndef KD_TREE_CPP
+#define KD_TREE_CPP
+
+/**
+ * A k-d tree over the points being clustered, used to run the k-means
+ * assignment step with the filtering algorithm.  See KdTree.h for an
+ * overview.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+#include "KdTree.h"
+
+// Like Elkan.h, a candidate centroid is dropped only when it is
+// strictly farther than another candidate from every point in a box.
+// Ties are left for the leaves, which break them in favor of the
+// lower index just like CentroidTable.  So the assignments are the
+// same as the plain Lloyd iterations.
+
+/** The depth of the subtrees that are processed in parallel. */
+constexpr int ParallelDepth = 6;
+
+/**
+ * Computes the squared distance between two points.
+ *
+ * \param[in] p1 The coordinates of the first point.
+ *
+ * \param[in] p2 The coordinates of the second point.
+ *
+ * \param[in] dims The number of coordinates in each point.
+ */
+static double distSq(const double* p1, const double* p2, const int dims) {
+    double sum = 0;
+    for (int i = 0; (i < dims); i++) {
+        const double diff = p1[i] - p2[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+KdTree::KdTree(const PointArray& pts, const int leafSize) :
+    dims(pts.dims()), leafSize(std::max(leafSize, 1)),
+    points(pts.size(), pts.dims()), index(pts.size()) {
+    if (dims > MaxDims) {
+        throw std::invalid_argument("KdTree supports up to " +
+                                    std::to_string(MaxDims) + " dimensions");
+    }
+    std::iota(index.begin(), index.end(), 0);
+    if (pts.size() > 0) {
+        build(0, pts.size(), 0, pts);
+    }
+    // Copy the points in the tree's order.
+    for (size_t i = 0; (i < index.size()); i++) {
+        std::copy_n(pts[index[i]], dims, points[i]);
+    }
+}
+
+int
+KdTree::build(size_t begin, size_t end, const int level,
+              const PointArray& pts) {
+    const int node = nodes.size();
+    depth = std::max(depth, level + 1);
+    nodes.push_back({begin, end});
+    // Compute the bounding box and sum of the points in this node.
+    lo.insert(lo.end(), pts[index[begin]], pts[index[begin]] + dims);
+    hi.insert(hi.end(), lo.end() - dims, lo.end());
+    sum.resize(sum.size() + dims, 0);
+    double *low = &lo[node * dims], *high = &hi[node * dims];
+    double *total = &sum[node * dims];
+    for (size_t i = begin; (i < end); i++) {
+        const double* pt = pts[index[i]];
+        for (int d = 0; (d < dims); d++) {
+            low[d]   = std::min(low[d], pt[d]);
+            high[d]  = std::max(high[d], pt[d]);
+            total[d] += pt[d];
+        }
+    }
+    if (end - begin <= size_t(leafSize)) {
+        return node;
+    }
+    // Split the points at the median of the widest dimension.
+    int split = 0;
+    for (int d = 1; (d < dims); d++) {
+        if (high[d] - low[d] > high[split] - low[split]) {
+            split = d;
+        }
+    }
+    if (high[split] == low[split]) {
+        return node;  // All the points are the same.
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(index.begin() + begin, index.begin() + mid,
+                     index.begin() + end, [&](size_t a, size_t b) {
+                         return pts[a][split] < pts[b][split];
+                     });
+    const int left  = build(begin, mid, level + 1, pts);
+    const int right = build(mid, end, level + 1, pts);
+    nodes[node].left  = left;
+    nodes[node].right = right;
+    return node;
+}
+
+void
+KdTree::subtrees(const int node, const int depth,
+                 std::vector<int>& roots) const {
+    if ((depth == 0) || (nodes[node].left == -1)) {
+        roots.push_back(node);
+    } else {
+        subtrees(nodes[node].left, depth - 1, roots);
+        subtrees(nodes[node].right, depth - 1, roots);
+    }
+}
+
+long
+KdTree::filter(const PointList& centroids, CentroidSums& sums,
+               [[maybe_unused]] const LloydOptions& opts,
+               IntVec* clsIdx) const {
+    const int k = centroids.size();
+    sums.reset(k, dims);
+    if (nodes.empty()) {
+        return 0;
+    }
+    // Copy the centroids into one buffer to avoid chasing pointers.
+    std::vector<double> flat(k * dims);
+    for (int c = 0; (c < k); c++) {
+        std::copy_n(&centroids[c][0], dims, &flat[c * dims]);
+    }
+    // The subtrees do not depend on the number of threads and their
+    // sums are merged in order, so the results are deterministic.
+    std::vector<int> roots;
+    subtrees(0, ParallelDepth, roots);
+    std::vector<CentroidSums> partial(roots.size(), sums);
+    long distCount = 0;
+    #pragma omp parallel num_threads(threadCount(opts)) reduction(+:distCount)
+    {
+        // The candidates at each level, with all of them at the top.
+        std::vector<int> cand(k * depth);
+        std::iota(cand.begin(), cand.begin() + k, 0);
+        #pragma omp for schedule(dynamic)
+        for (size_t r = 0; r < roots.size(); r++) {
+            distCount += filter(roots[r], cand, 0, k, flat.data(),
+                                partial[r], clsIdx);
+        }
+    }
+    for (const auto& part : partial) {
+        sums.merge(part);
+    }
+    return distCount;
+}
+
+long
+KdTree::filter(const int node, std::vector<int>& cand, const int level,
+               const int count, const double* centroids,
+               CentroidSums& sums, IntVec* clsIdx) const {
+    const Node& nd = nodes[node];
+    const int k = sums.countValues().size();
+    const int* zs = &cand[level * k];
+    if (count == 1) {
+        // The whole subtree belongs to the only candidate.
+        sums.add(zs[0], &sum[node * dims], long(nd.end - nd.begin));
+        if (clsIdx != nullptr) {
+            for (size_t i = nd.begin; (i < nd.end); i++) {
+                (*clsIdx)[index[i]] = zs[0];
+            }
+        }
+        return 0;
+    }
+    if (nd.left == -1) {
+        // Assign each point in the leaf to the closest candidate.
+        for (size_t i = nd.begin; (i < nd.end); i++) {
+            const double* pt = points[i];
+            int closest = zs[0];
+            double best = distSq(pt, &centroids[closest * dims], dims);
+            for (int j = 1; (j < count); j++) {
+                const double dist = distSq(pt, &centroids[zs[j] * dims], dims);
+                if (dist < best) {
+                    best    = dist;
+                    closest = zs[j];
+                }
+            }
+            sums.add(closest, pt);
+            if (clsIdx != nullptr) {
+                (*clsIdx)[index[i]] = closest;
+            }
+        }
+        return long(nd.end - nd.begin) * count;
+    }
+    // Find the candidate closest to the middle of the box.
+    const double *low = &lo[node * dims], *high = &hi[node * dims];
+    double mid[MaxDims], corner[MaxDims];
+    for (int d = 0; (d < dims); d++) {
+        mid[d] = 0.5 * (low[d] + high[d]);
+    }
+    int best = zs[0];
+    double bestDist = distSq(mid, &centroids[best * dims], dims);
+    for (int j = 1; (j < count); j++) {
+        const double dist = distSq(mid, &centroids[zs[j] * dims], dims);
+        if (dist < bestDist) {
+            bestDist = dist;
+            best     = zs[j];
+        }
+    }
+    // Drop the candidates that are farther than the best one from the
+    // corner of the box in their direction (and so from every point
+    // in the box).  The candidates stay in increasing index order.
+    const double* z1 = &centroids[best * dims];
+    int* keep = &cand[(level + 1) * k];
+    int kept = 0;
+    for (int j = 0; (j < count); j++) {
+        const double* z = &centroids[zs[j] * dims];
+        if (zs[j] != best) {
+            for (int d = 0; (d < dims); d++) {
+                corner[d] = (z[d] > z1[d]) ? high[d] : low[d];
+            }
+            if (distSq(z, corner, dims) > distSq(z1, corner, dims)) {
+                continue;
+            }
+        }
+        keep[kept++] = zs[j];
+    }
+    long distCount = count + 2 * (count - 1);
+    distCount += filter(nd.left, cand, level + 1, kept, centroids, sums,
+                        clsIdx);
+    distCount += filter(nd.right, cand, level + 1, kept, centroids, sums,
+                        clsIdx);
+    return distCount;
+}
+
+IntVec kdTreeKmeans(const PointArray& points, PointList& centroids,
+                    const LloydOptions& opts, int* iterations,
+                    long* distCount) {
+    if (points.dims() > KdTree::MaxDims) {
+        // The boxes prune too few centroids; use the linear scan.
+        LloydOptions linear = opts;
+        linear.accel = Accel::None;
+        return setClosestCentroid(points, centroids, linear, iterations,
+                                  distCount);
+    }
+    // The points do not move, so one tree is used for all iterations.
+    const KdTree tree(points);
+    IntVec centIdx(points.size());
+    CentroidSums sums;
+    int iteration = 0;
+    long distances = 0;
+    while (iteration < opts.maxIterations) {
+        // The sums come from whole subtrees, so they are recomputed
+        // each iteration.  The assignments are compared only to count
+        // the points that changed centroids.
+        const IntVec prevIdx = centIdx;
+        distances += tree.filter(centroids, sums, opts, &centIdx);
+        long changed = points.size();
+        if (iteration > 0) {
+            changed = 0;
+            for (size_t i = 0; (i < centIdx.size()); i++) {
+                changed += (centIdx[i] != prevIdx[i]);
+            }
+        }
+        iteration++;
+        // move each centroid to the mean of its points
+        const PointList prevCentroids = centroids;
+        for (size_t c = 0; (c < centroids.size()); c++) {
+            sums.computeNewCentroid(c, centroids[c]);
+        }
+        if (converged(prevCentroids, centroids, changed, opts)) {
+            break;
+        }
+    }
+    if (iterations != nullptr) {
+        *iterations = iteration;
+    }
+    if (distCount != nullptr) {
+        *distCount = distances;
+    }
+    return centIdx;
+}
+
+#endif
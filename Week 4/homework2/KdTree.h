@@ -0,0 +1,175 @@
+#ifndef KD_TREE_H
+#define KD_TREE_H
+
+/**
+ * A k-d tree over the points being clustered, used to run the k-means
+ * assignment step with the filtering algorithm of Kanungo et al.
+ * ("An efficient k-means clustering algorithm: analysis and
+ * implementation", 2002).
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+
+/**
+ * A k-d tree in which each node stores the bounding box, the number
+ * of points, and the sum of the points in its subtree.
+ *
+ * The filtering algorithm pushes the list of candidate centroids down
+ * the tree.  At each node, the candidate closest to the middle of the
+ * node's box is found, and any candidate that is farther than it from
+ * every corner of the box is dropped.  When only one candidate is
+ * left, the whole subtree is added to that centroid's sums at once
+ * using the node's count and sum.  So for large k most points are
+ * never compared with most centroids.
+ *
+ * The points do not change between iterations, so the tree is built
+ * once and reused for every iteration.  The tree holds its own copy
+ * of the points, ordered so that each subtree is a contiguous range.
+ */
+class KdTree {
+public:
+    /**
+     * Builds a tree over a given set of points.
+     *
+     * \param[in] points The points to be stored in the tree.  They
+     * must not have more than MaxDims dimensions.
+     *
+     * \param[in] leafSize The maximum number of points in a leaf.
+     */
+    explicit KdTree(const PointArray& points, const int leafSize = 16);
+
+    /**
+     * Computes the per-centroid sums for one k-means iteration using
+     * the filtering algorithm.  This is equivalent to assigning each
+     * point to its closest centroid and adding it to that centroid's
+     * sums.  The subtrees near the root are processed in parallel.
+     *
+     * \param[in] centroids The current centroids.
+     *
+     * \param[out] sums The per-centroid sums and counts.
+     *
+     * \param[in] opts The threads and reduction mode to be used.  The
+     * sums are always merged in the same order, so the results do not
+     * depend on the number of threads.
+     *
+     * \param[out] clsIdx If not null, the index of the closest centroid
+     * for each point (in the order of the points given to the
+     * constructor) is stored here.
+     *
+     * \return The number of point-centroid distances computed.
+     */
+    long filter(const PointList& centroids, CentroidSums& sums,
+                const LloydOptions& opts, IntVec* clsIdx = nullptr) const;
+
+    /**
+     * The highest number of dimensions for which the tree is used.
+     * The boxes in a k-d tree prune poorly in higher dimensions, so
+     * kdTreeKmeans() falls back to the linear scan above this.
+     */
+    static constexpr int MaxDims = 10;
+
+private:
+    /** A node in the tree.  Leaves have no children. */
+    struct Node {
+        /// The range of points (in the tree's order) in this subtree.
+        size_t begin, end;
+        /// The index of the two children, or -1 for a leaf.
+        int left = -1, right = -1;
+    };
+
+    /**
+     * Recursively builds the subtree for a range of points.
+     *
+     * \return The index of the node created for the range.
+     */
+    int build(size_t begin, size_t end, const int level,
+              const PointArray& points);
+
+    /**
+     * Recursively runs the filtering algorithm on a subtree.
+     *
+     * \param[in] node The index of the root of the subtree.
+     *
+     * \param[in,out] cand The candidate centroids for each level of
+     * the tree, k entries per level.  The candidates for this node
+     * are the first \c count entries at \c level.
+     *
+     * \param[in] level The level of this node, relative to the root
+     * of the subtree being processed.
+     *
+     * \param[in] count The number of candidate centroids.
+     *
+     * \param[in] centroids The current centroids, k * dims values.
+     *
+     * \param[out] sums The sums to which points are to be added.
+     *
+     * \param[out] clsIdx If not null, the closest centroid of each point.
+     *
+     * \return The number of distances computed.
+     */
+    long filter(const int node, std::vector<int>& cand, const int level,
+                const int count, const double* centroids,
+                CentroidSums& sums, IntVec* clsIdx) const;
+
+    /**
+     * Adds the subtrees with roots at a given depth (or leaves above
+     * it) to a list.  These are the units of parallel work.
+     *
+     * \param[in] node The index of the root of the subtree.
+     *
+     * \param[in] depth The remaining depth to descend.
+     *
+     * \param[out] roots The list to which the subtrees are added.
+     */
+    void subtrees(const int node, const int depth,
+                  std::vector<int>& roots) const;
+
+    /// The number of dimensions of each point.
+    int dims;
+    /// The maximum number of points in a leaf.
+    int leafSize;
+    /// The number of levels in the tree.
+    int depth = 0;
+    /// The points, ordered so each subtree is a contiguous range.
+    PointArray points;
+    /// The index (in the original order) of each point in the tree.
+    std::vector<size_t> index;
+    /// The nodes in the tree.  The root is node 0.
+    std::vector<Node> nodes;
+    /// The lower and upper corners of the box of each node.
+    std::vector<double> lo, hi;
+    /// The sum of the points in each node.
+    std::vector<double> sum;
+};
+
+/**
+ * Runs k-means using the k-d tree filtering algorithm for the
+ * assignment step.  The parameters are the same as
+ * setClosestCentroid() in Lloyd.h.  If the points have more than
+ * KdTree::MaxDims dimensions, this method just uses the linear scan.
+ *
+ * \param[in] points The points being clustered.
+ *
+ * \param[in,out] centroids The initial centroids.  They are updated
+ * to the final centroids.
+ *
+ * \param[in] opts The options controlling the iterations.
+ *
+ * \param[out] iterations If not null, the number of iterations run
+ * is stored here.
+ *
+ * \param[out] distCount If not null, the number of point-centroid
+ * distances computed is stored here.
+ *
+ * \return The index of the centroid closest to each corresponding point.
+ */
+IntVec kdTreeKmeans(const PointArray& points, PointList& centroids,
+                    const LloydOptions& opts = {}, int* iterations = nullptr,
+                    long* distCount = nullptr);
+
+#endif
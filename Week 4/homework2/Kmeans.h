@@ -20,14 +20,61 @@
  *       clustering.  If this value is zero, just print the data
  *       read for the specified number of columns by calling writeResults()
  *       method (already implemented).
+ *    4. Optional arguments (see parseOptions() in main.cpp):
+ *         --threads N      The number of threads to be used.
+ *         --deterministic  Make results independent of the threads.
+ *         --tolerance T    Stop when no centroid moves more than T.
+ *         --changed N      Stop when at most N points change clusters.
+ *         --accel A        Use the triangle-inequality accelerated
+ *                          algorithms (elkan or hamerly) or the k-d
+ *                          tree filtering algorithm (kdtree).
+ *         --minibatch B    Stream the file and run mini-batch k-means
+ *                          with batches of B points.
+ *         --batches T      The number of mini-batches.
+ *         --init I         How the initial centroids are picked: random,
+ *                          kmeans++, or kmeans|| (see Seeding.h).
+ *         --seed S         The seed for picking the initial centroids.
+ *         --restarts R     Run R restarts (seeds S, S+1, ...) for each k
+ *                          concurrently (see MultiRun.h).
+ *         --kmax K         Try every k from NumCentroids to K, print the
+ *                          elbow curve to std::cerr, and write the best
+ *                          solution at the elbow.
+ *         --float          Store the points and compute distances in
+ *                          single precision (centroid sums stay in
+ *                          double).  Not supported with --accel.
+ *         --mmap           Memory-map a binary point file and cluster
+ *                          it out-of-core (see MappedPoints.h).
+ *         --coreset M      Cluster a coreset of about M weighted points
+ *                          (see Coreset.h), seeded with weighted
+ *                          k-means++, then assign all the points.
+ *         --online         Run online k-means over the points as they
+ *                          are read and write snapshots of the
+ *                          centroids (see OnlineKmeans.h).  The file
+ *                          may be "-" to read std::cin.
+ *         --decay D        Fade the weight of older points (D < 1).
+ *         --every N        Write a snapshot every N points.
+ *         --interval T     Write a snapshot every T seconds.
+ *         --stats          Print the number of iterations, distance
+ *                          computations, and the time to std::cerr.
+ *       The input file may also be a binary point file (see
+ *       PointStream.h), which tsv2bin.cpp creates from a TSV file.
  *
  * Optionally the output can be visualized using Gnuplot via the
  * following command:
  *   $ ./main old_faithful.tsv 2 2 > temp.tsv
  *   $ gnuplot -e 'set terminal png; set output "temp.png"; plot "temp.tsv" using 3:4:1:2 with points pt var lc var;'
+ *
+ * The program is compiled from the following sources.  Use
+ * -march=native to enable the AVX2/AVX-512 assignment kernels:
+ *   $ g++ -std=c++17 -O3 -march=native -fopenmp -o main main.cpp \
+ *         KmeansHelper.cpp CentroidTable.cpp Lloyd.cpp Elkan.cpp \
+ *         KdTree.cpp PointStream.cpp MiniBatch.cpp Seeding.cpp \
+ *         MultiRun.cpp MappedPoints.cpp Coreset.cpp PointLoader.cpp \
+ *         OnlineKmeans.cpp
  */
 
 #include <valarray>
+#include <random>
 #include <vector>
 #include <iostream>
 
@@ -62,10 +109,37 @@ using IntVec = std::vector<int>;
  * \param[in] numCentroids The number of centroids to be returned by
  * this method.
  *
+ * \param[in] seed The seed for the random number generator.  The
+ * default is the seed of a default-constructed random engine.
+ *
  * \return A randomly selected set of points as initial set of
  * centroids.
  */
-PointList getInitCentroid(const PointList& data, const int numCentroids);
+PointList getInitCentroid(const PointList& data, const int numCentroids,
+                          const unsigned seed =
+                          std::default_random_engine::default_seed);
+
+/**
+ * Picks a uniformly random subset of the indexes 0 to total - 1.
+ * These are the positions std::sample picks from any range of total
+ * values with the same seed, so the points at these indexes are the
+ * centroids getInitCentroid() returns.  std::sample is run over the
+ * indexes one at a time (selection sampling, Knuth's Algorithm S),
+ * so no list of all the indexes is built: the memory used is
+ * O(count) however many points there are.
+ *
+ * \param[in] total The number of indexes to pick from.
+ *
+ * \param[in] count The number of indexes to be picked.  At most
+ * total indexes are returned.
+ *
+ * \param[in] seed The seed for the random number generator.
+ *
+ * \return The picked indexes, in increasing order.
+ */
+std::vector<size_t> sampleIndexes(const size_t total, const size_t count,
+                                  const unsigned seed =
+                                  std::default_random_engine::default_seed);
 
 /**
  * Just a convenience stream-insertion operator to print a given
@@ -94,6 +168,68 @@ std::ostream& operator<<(std::ostream& os, const Point& pt);
  */
 double distance(const Point& p1, const Point& p2);
 
+/**
+ * Computes the square of the Euclidean distance between two points.
+ * Comparing squared distances gives the same ordering as comparing
+ * distances, but avoids the sqrt and the temporary std::valarray
+ * objects used by distance().
+ *
+ * \param[in] p1 The first point.
+ *
+ * \param[in] p2 The second point. It must have the same dimensions
+ * as p1.
+ *
+ * \return The squared Euclidean distance between the two points.
+ */
+double distanceSq(const Point& p1, const Point& p2);
+
+/** The flat list of points declared in PointArray.h. */
+template<typename Real>
+class BasicPointArray;
+
+/**
+ * Computes the sum of the distances of each point from its assigned
+ * centroid.  This is the same as the getTotDist() helper used by
+ * writeResults(), but for points stored in a PointArray (or
+ * PointArrayF).  It is used to compare different clustering solutions
+ * of the same points.  The distances are added up in double.
+ *
+ * \param[in] data The points being clustered.
+ *
+ * \param[in] centroids The centroids to which the points are assigned.
+ *
+ * \param[in] idx The index of the centroid for each point.
+ *
+ * \return The total distance between the points and their
+ * centroids, or -1 if idx does not have an entry for each point.
+ */
+template<typename Real>
+double getTotDist(const BasicPointArray<Real>& data,
+                  const PointList& centroids, const IntVec& idx);
+
+/**
+ * Computes the weighted sum of the distances of each point from its
+ * assigned centroid.  This is the getTotDist() of weighted points,
+ * such as a coreset (see Coreset.h), which estimates the total
+ * distance of the points they stand for.
+ *
+ * \param[in] data The points being clustered.
+ *
+ * \param[in] weights The weight of each point.
+ *
+ * \param[in] centroids The centroids to which the points are assigned.
+ *
+ * \param[in] idx The index of the centroid for each point.
+ *
+ * \return The weighted total distance between the points and their
+ * centroids, or -1 if idx or weights does not have an entry for each
+ * point.
+ */
+template<typename Real>
+double getTotDist(const BasicPointArray<Real>& data,
+                  const std::vector<double>& weights,
+                  const PointList& centroids, const IntVec& idx);
+
 /**
  * This method writes results to a given output stream in the required
  * TSV format.  It also prints the total distance measure at the end.
@@ -115,4 +251,22 @@ double distance(const Point& p1, const Point& p2);
 void writeResults(const PointList& data, const PointList& centroids,
                   const IntVec& clsIdx, std::ostream& os = std::cout);
 
+/**
+ * This method writes results in the same format as the method above,
+ * for points stored in a PointArray.
+ *
+ * \param[in] data The data points being clustered.
+ *
+ * \param[in] centroids The current set of centroids.
+ *
+ * \param[in] clsIdx The index of the nearest centroid for each data
+ * point, or an empty vector if the points have not been clustered.
+ *
+ * \param[out] os The output stream to where the data should be
+ * written as a TSV.
+ */
+void writeResults(const BasicPointArray<double>& data,
+                  const PointList& centroids, const IntVec& clsIdx,
+                  std::ostream& os = std::cout);
+
 #endif
@@ -8,9 +8,12 @@
  * Copyright (c) 2021 raodm@miamioh.edu
 */
 
+#include <cmath>
 #include <random>
 #include <algorithm>
+#include <iterator>
 #include "Kmeans.h"
+#include "PointArray.h"
 
 /**
  * This is a helper method to randomly select a subset of points as
@@ -22,19 +25,59 @@
  * \param[in] numCentroids The number of centroids to be returned by
  * this method.
  *
+ * \param[in] seed The seed for the random number generator.
+ *
  * \return A randomly selected set of points as initial set of
  * centroids.
  */
-PointList getInitCentroid(const PointList& data, const int numCentroids) {
+PointList getInitCentroid(const PointList& data, const int numCentroids,
+                          const unsigned seed) {
     PointList centroids(numCentroids);
     // Pick a random subset of points for use as centroids using the
     // built-in sample algorithm.
     std::sample(std::begin(data), std::end(data), std::begin(centroids),
-                numCentroids, std::default_random_engine());
+                numCentroids, std::default_random_engine(seed));
     // Return a randomly selected initial centroids.
     return centroids;
 }
 
+/**
+ * A forward iterator over the indexes 0, 1, 2, ... that stores only
+ * the current index, so that std::sample can pick indexes without a
+ * list of them.
+ */
+class IndexIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = size_t;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const size_t*;
+    using reference         = const size_t&;
+
+    explicit IndexIterator(const size_t idx = 0) : idx(idx) {}
+
+    reference operator*() const { return idx; }
+    IndexIterator& operator++() { idx++; return *this; }
+    IndexIterator operator++(int) { return IndexIterator(idx++); }
+    bool operator==(const IndexIterator& other) const {
+        return idx == other.idx;
+    }
+    bool operator!=(const IndexIterator& other) const {
+        return idx != other.idx;
+    }
+
+private:
+    size_t idx;
+};
+
+std::vector<size_t> sampleIndexes(const size_t total, const size_t count,
+                                  const unsigned seed) {
+    std::vector<size_t> picked(std::min(count, total));
+    std::sample(IndexIterator(0), IndexIterator(total), picked.begin(),
+                picked.size(), std::default_random_engine(seed));
+    return picked;
+}
+
 
 /**
  * Just a convenience stream-insertion operator to print a given
@@ -70,6 +113,26 @@ double distance(const Point& p1, const Point& p2) {
     return std::sqrt(std::pow(p1 - p2, 2).sum());        
 }
 
+/**
+ * Computes the square of the Euclidean distance between two points
+ * without creating any temporary std::valarray objects.
+ *
+ * \param[in] p1 The first point.
+ *
+ * \param[in] p2 The second point. It must have the same dimensions
+ * as p1.
+ *
+ * \return The squared Euclidean distance between the two points.
+ */
+double distanceSq(const Point& p1, const Point& p2) {
+    double sum = 0;
+    for (size_t i = 0; (i < p1.size()); i++) {
+        const double diff = p1[i] - p2[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
 /**
  * Helper method to compute the sum of distances for each point from
  * its assigned centroid.  This is just used to provide some
@@ -104,6 +167,60 @@ double getTotDist(const PointList& data, const PointList& centroids,
     return dist;
 }
 
+/**
+ * The total distance of points in a PointArray from their centroids,
+ * with each distance multiplied by the weight of its point.
+ *
+ * \param[in] weights The weight of each point, or nullptr if every
+ * point has a weight of 1.
+ */
+template<typename Real>
+static double weightedTotDist(const BasicPointArray<Real>& data,
+                              const double* weights,
+                              const PointList& centroids, const IntVec& idx) {
+    double dist = 0;
+    for (size_t i = 0; (i < data.size()); i++) {
+        const Point& c = centroids.at(idx[i]);
+        const Real* pt = data[i];
+        double sum = 0;
+        for (int j = 0; (j < data.dims()); j++) {
+            sum += (pt[j] - c[j]) * (pt[j] - c[j]);
+        }
+        dist += (weights != nullptr) ? weights[i] * std::sqrt(sum) :
+            std::sqrt(sum);
+    }
+    return dist;
+}
+
+template<typename Real>
+double getTotDist(const BasicPointArray<Real>& data,
+                  const PointList& centroids, const IntVec& idx) {
+    if (data.size() != idx.size()) {
+        return -1;
+    }
+    return weightedTotDist(data, nullptr, centroids, idx);
+}
+
+template<typename Real>
+double getTotDist(const BasicPointArray<Real>& data,
+                  const std::vector<double>& weights,
+                  const PointList& centroids, const IntVec& idx) {
+    if ((data.size() != idx.size()) || (data.size() != weights.size())) {
+        return -1;
+    }
+    return weightedTotDist(data, weights.data(), centroids, idx);
+}
+
+// The versions of getTotDist() for the supported precisions.
+template double getTotDist(const PointArray&, const PointList&,
+                           const IntVec&);
+template double getTotDist(const PointArrayF&, const PointList&,
+                           const IntVec&);
+template double getTotDist(const PointArray&, const std::vector<double>&,
+                           const PointList&, const IntVec&);
+template double getTotDist(const PointArrayF&, const std::vector<double>&,
+                           const PointList&, const IntVec&);
+
 
 /**
  * This method writes results to a given output stream in the required
@@ -146,4 +263,22 @@ void writeResults(const PointList& data, const PointList& centroids,
     os << "# Total distance measure: " << totDist << std::endl;
 }
 
+void writeResults(const PointArray& data, const PointList& centroids,
+                  const IntVec& clsIdx, std::ostream& os) {
+    os << "#PointType\tCentroidIndex\tCoordinates\n";
+    for (size_t i = 0; (i < data.size()); i++) {
+        os << "1\t" << (!clsIdx.empty() ? clsIdx.at(i) : -1) << '\t';
+        for (int j = 0; (j < data.dims()); j++) {
+            os << data[i][j] << '\t';
+        }
+        os << '\n';
+    }
+    for (size_t i = 0; (i < centroids.size()); i++) {
+        os << "7\t" << i << '\t' << centroids.at(i) << '\n';
+    }
+    const auto totDist = (clsIdx.empty() ? -1 :
+                          getTotDist(data, centroids, clsIdx));
+    os << "# Total distance measure: " << totDist << std::endl;
+}
+
 #endif
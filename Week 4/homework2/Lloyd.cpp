@@ -0,0 +1,201 @@
+#ifndef LLOYD_CPP
+#define LLOYD_CPP
+
+/**
+ * The parallel Lloyd iterations used for k-means clustering.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <stdexcept>
+#include <type_traits>
+#include "Lloyd.h"
+#include "Elkan.h"
+#include "KdTree.h"
+
+void
+CentroidSums::merge(const CentroidSums& other) {
+    for (size_t i = 0; (i < sums.size()); i++) {
+        sums[i] += other.sums[i];
+    }
+    for (size_t c = 0; (c < counts.size()); c++) {
+        counts[c]  += other.counts[c];
+        weights[c] += other.weights[c];
+    }
+}
+
+void
+CentroidSums::computeNewCentroid(const int c, Point& centroid) const {
+    // An empty cluster keeps its previous location.
+    if (counts[c] == 0) {
+        return;
+    }
+    // divide each dimension of the sum by the count in order to
+    // average the centroid out
+    for (int i = 0; (i < dims); i++) {
+        centroid[i] = sums[c * dims + i] / counts[c];
+    }
+}
+
+void
+CentroidSums::computeWeightedCentroid(const int c, Point& centroid) const {
+    // A cluster without any weight keeps its previous location.
+    if (!(weights[c] > 0)) {
+        return;
+    }
+    for (int i = 0; (i < dims); i++) {
+        centroid[i] = sums[c * dims + i] / weights[c];
+    }
+}
+
+bool centroidsSame(const PointList& prevCentroids,
+                   const PointList& centroids) {
+    for (size_t i = 0; i < centroids.size(); i++) {
+        for (size_t j = 0; j < centroids[0].size(); j++) {
+            // if points are not equal, then return false as the PointLists are
+            // not the same
+            if (centroids[i][j] != prevCentroids[i][j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool converged(const PointList& prevCentroids, const PointList& centroids,
+               const long changed, const LloydOptions& opts) {
+    if ((opts.changedTolerance >= 0) && (changed >= 0) &&
+        (changed <= opts.changedTolerance)) {
+        return true;
+    }
+    if (opts.tolerance <= 0) {
+        return centroidsSame(prevCentroids, centroids);
+    }
+    // Compare squared distances to avoid the sqrt.
+    const double tolSq = opts.tolerance * opts.tolerance;
+    for (size_t c = 0; (c < centroids.size()); c++) {
+        if (distanceSq(prevCentroids[c], centroids[c]) > tolSq) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Real>
+long lloydStep(const BasicPointArray<Real>& points,
+               const BasicCentroidTable<Real>& table, IntVec& clsIdx,
+               CentroidSums& sums, const LloydOptions& opts) {
+    sums.reset(table.size(), table.dims());
+    return reduceRanges(points.size(), sums, opts,
+                        [&](size_t begin, size_t end, CentroidSums& local) {
+        // assign the range and add each point to its centroid's sums
+        table.nearest(points, begin, end, clsIdx.data() + begin);
+        for (size_t i = begin; (i < end); i++) {
+            local.add(clsIdx[i], points[i]);
+        }
+        return long(end - begin) * table.size();
+    });
+}
+
+template<typename Real>
+long lloydUpdate(const BasicPointArray<Real>& points,
+                 const BasicCentroidTable<Real>& table, IntVec& clsIdx,
+                 CentroidSums& sums, const LloydOptions& opts, long& changed) {
+    // Only the changes are reduced and then applied to the sums.
+    CentroidSums delta(table.size(), table.dims());
+    changed = 0;
+    const long distCount = reduceRanges(points.size(), delta, opts,
+                                        [&](size_t begin, size_t end,
+                                            CentroidSums& local) {
+        IntVec idx(end - begin);
+        table.nearest(points, begin, end, idx.data());
+        long moved = 0;
+        for (size_t i = begin; (i < end); i++) {
+            const int c = idx[i - begin];
+            if (c != clsIdx[i]) {
+                local.remove(clsIdx[i], points[i]);
+                local.add(c, points[i]);
+                clsIdx[i] = c;
+                moved++;
+            }
+        }
+        #pragma omp atomic
+        changed += moved;
+        return long(end - begin) * table.size();
+    });
+    sums.merge(delta);
+    return distCount;
+}
+
+template<typename Real>
+IntVec setClosestCentroid(const BasicPointArray<Real>& points,
+                          PointList& centroids, const LloydOptions& opts,
+                          int* iterations, long* distCount) {
+    // Use the accelerated algorithms if requested.
+    if constexpr (std::is_same_v<Real, double>) {
+        if (opts.accel == Accel::Elkan) {
+            return elkanKmeans(points, centroids, opts, iterations,
+                               distCount);
+        } else if (opts.accel == Accel::Hamerly) {
+            return hamerlyKmeans(points, centroids, opts, iterations,
+                                 distCount);
+        } else if (opts.accel == Accel::KdTree) {
+            return kdTreeKmeans(points, centroids, opts, iterations,
+                                distCount);
+        }
+    } else if (opts.accel != Accel::None) {
+        throw std::invalid_argument("The accelerated algorithms need "
+                                    "double precision points");
+    }
+    IntVec centIdx(points.size());
+    BasicCentroidTable<Real> table;
+    CentroidSums sums;
+    int iteration = 0;
+    long distances = 0;
+    while (iteration < opts.maxIterations) {
+        // assign each point and sum up the points for each centroid.
+        // After the first iteration only the changed points are moved.
+        table.load(centroids);
+        long changed = points.size();
+        if (iteration == 0) {
+            distances += lloydStep(points, table, centIdx, sums, opts);
+        } else {
+            distances += lloydUpdate(points, table, centIdx, sums, opts,
+                                     changed);
+        }
+        iteration++;
+        // move each centroid to the mean of its points
+        const PointList prevCentroids = centroids;
+        for (size_t c = 0; (c < centroids.size()); c++) {
+            sums.computeNewCentroid(c, centroids[c]);
+        }
+        // check for convergence so that we don't do unnecessary
+        // iterations
+        if (converged(prevCentroids, centroids, changed, opts)) {
+            break;
+        }
+    }
+    if (iterations != nullptr) {
+        *iterations = iteration;
+    }
+    if (distCount != nullptr) {
+        *distCount = distances;
+    }
+    return centIdx;
+}
+
+// The versions of the Lloyd iterations for the supported precisions.
+template long lloydStep(const PointArray&, const CentroidTable&, IntVec&,
+                        CentroidSums&, const LloydOptions&);
+template long lloydStep(const PointArrayF&, const CentroidTableF&, IntVec&,
+                        CentroidSums&, const LloydOptions&);
+template long lloydUpdate(const PointArray&, const CentroidTable&, IntVec&,
+                          CentroidSums&, const LloydOptions&, long&);
+template long lloydUpdate(const PointArrayF&, const CentroidTableF&, IntVec&,
+                          CentroidSums&, const LloydOptions&, long&);
+template IntVec setClosestCentroid(const PointArray&, PointList&,
+                                   const LloydOptions&, int*, long*);
+template IntVec setClosestCentroid(const PointArrayF&, PointList&,
+                                   const LloydOptions&, int*, long*);
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef LLOYD_H
+#define LLOYD_H
+
+/**
+ * The Lloyd iterations (assign points, then move centroids) used for
+ * k-means clustering.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <algorithm>
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "CentroidTable.h"
+
+/**
+ * The algorithms that can be used to find the closest centroids.
+ * See Elkan.h and KdTree.h for the accelerated versions.
+ */
+enum class Accel { None, Elkan, Hamerly, KdTree };
+
+/**
+ * The options that control how the Lloyd iterations are run.
+ */
+struct LloydOptions {
+    /// The maximum number of iterations to be run.
+    int maxIterations = 100;
+
+    /// The number of threads to be used.  Zero uses the OpenMP
+    /// default (typically the number of cores or OMP_NUM_THREADS).
+    int threads = 0;
+
+    /// If true, the per-centroid sums are always combined in the
+    /// same order, independent of the number of threads, so that
+    /// results are bit-for-bit reproducible.
+    bool deterministic = false;
+
+    /// The iterations stop when no centroid moves farther than this
+    /// distance.  Zero stops only when the centroids stop changing.
+    double tolerance = 0;
+
+    /// If not negative, the iterations also stop when at most these
+    /// many points are assigned to a different centroid.
+    long changedTolerance = -1;
+
+    /// Use a triangle-inequality accelerated algorithm or the k-d
+    /// tree filtering algorithm to skip distance computations.  The
+    /// assignments are the same.
+    Accel accel = Accel::None;
+};
+
+/**
+ * The sum of the coordinates and the number of points assigned to
+ * each centroid.  An assignment pass accumulates points into this
+ * object, from which the new centroids are then computed.
+ */
+class CentroidSums {
+public:
+    /**
+     * Creates zero-initialized sums for a given number of centroids.
+     *
+     * \param[in] k The number of centroids.
+     *
+     * \param[in] dims The number of dimensions of each centroid.
+     */
+    explicit CentroidSums(const int k = 0, const int dims = 0) {
+        reset(k, dims);
+    }
+
+    /**
+     * Sets all the sums and counts back to zero.
+     *
+     * \param[in] k The number of centroids.
+     *
+     * \param[in] dims The number of dimensions of each centroid.
+     */
+    void reset(const int k, const int dims) {
+        this->dims = dims;
+        sums.assign(k * dims, 0);
+        counts.assign(k, 0);
+        weights.assign(k, 0);
+    }
+
+    /**
+     * Adds a point to the sums for a given centroid.  The sums are
+     * always kept in double, even for single-precision points.
+     *
+     * \param[in] c The index of the centroid the point is assigned to.
+     *
+     * \param[in] pt The coordinates of the point.
+     */
+    template<typename Real>
+    void add(const int c, const Real* pt) {
+        double* sum = &sums[c * dims];
+        for (int i = 0; (i < dims); i++) {
+            sum[i] += pt[i];
+        }
+        counts[c]++;
+    }
+
+    /**
+     * Removes a point from the sums for a given centroid.  This is
+     * used to move a point that changed clusters without recomputing
+     * the sums from scratch.
+     *
+     * \param[in] c The index of the centroid the point was assigned to.
+     *
+     * \param[in] pt The coordinates of the point.
+     */
+    template<typename Real>
+    void remove(const int c, const Real* pt) {
+        double* sum = &sums[c * dims];
+        for (int i = 0; (i < dims); i++) {
+            sum[i] -= pt[i];
+        }
+        counts[c]--;
+    }
+
+    /**
+     * Adds a group of points to the sums for a given centroid, given
+     * the sum of the points in the group.
+     *
+     * \param[in] c The index of the centroid the points are assigned to.
+     *
+     * \param[in] sum The per-dimension sum of the points.
+     *
+     * \param[in] n The number of points in the group.
+     */
+    void add(const int c, const double* sum, const long n) {
+        double* dest = &sums[c * dims];
+        for (int i = 0; (i < dims); i++) {
+            dest[i] += sum[i];
+        }
+        counts[c] += n;
+    }
+
+    /**
+     * Adds a weighted point to the sums for a given centroid.  This is
+     * used to cluster weighted points, such as a coreset (see
+     * Coreset.h), whose centroids are computed with
+     * computeWeightedCentroid().
+     *
+     * \param[in] c The index of the centroid the point is assigned to.
+     *
+     * \param[in] pt The coordinates of the point.
+     *
+     * \param[in] weight The weight of the point.
+     */
+    template<typename Real>
+    void addWeighted(const int c, const Real* pt, const double weight) {
+        double* sum = &sums[c * dims];
+        for (int i = 0; (i < dims); i++) {
+            sum[i] += weight * pt[i];
+        }
+        counts[c]++;
+        weights[c] += weight;
+    }
+
+    /**
+     * Adds the sums and counts from another object to this one.
+     *
+     * \param[in] other The sums to be added. It must be for the same
+     * number of centroids and dimensions.
+     */
+    void merge(const CentroidSums& other);
+
+    /**
+     * Computes the new location of a centroid as the mean of the
+     * points assigned to it.
+     *
+     * \param[in] c The index of the centroid.
+     *
+     * \param[in,out] centroid The centroid to be updated.  If no
+     * points were assigned to the centroid, it is left unmodified.
+     */
+    void computeNewCentroid(const int c, Point& centroid) const;
+
+    /**
+     * Computes the new location of a centroid as the weighted mean of
+     * the points added to it with addWeighted().
+     *
+     * \param[in] c The index of the centroid.
+     *
+     * \param[in,out] centroid The centroid to be updated.  If the
+     * total weight of its points is zero, it is left unmodified.
+     */
+    void computeWeightedCentroid(const int c, Point& centroid) const;
+
+    /**
+     * Returns the number of points assigned to a centroid.
+     */
+    long count(const int c) const { return counts[c]; }
+
+    /**
+     * Returns the per-dimension sums (dims entries per centroid).
+     * This is used to reduce the sums across MPI processes.
+     */
+    std::vector<double>& sumValues() { return sums; }
+
+    /**
+     * Returns the number of points assigned to each centroid.  This
+     * is used to reduce the counts across MPI processes.
+     */
+    std::vector<long>& countValues() { return counts; }
+
+private:
+    /// The number of dimensions of each centroid.
+    int dims;
+    /// The per-dimension sums, dims entries for each centroid.
+    std::vector<double> sums;
+    /// The number of points assigned to each centroid.
+    std::vector<long> counts;
+    /// The total weight of the points added with addWeighted().
+    std::vector<double> weights;
+};
+
+/**
+ * Returns the number of threads to be used for a given set of
+ * options.
+ */
+#ifdef _OPENMP
+inline int threadCount(const LloydOptions& opts) {
+    return (opts.threads > 0) ? opts.threads : omp_get_max_threads();
+}
+#else
+inline int threadCount(const LloydOptions&) {
+    return 1;
+}
+#endif
+
+/** The number of points in each chunk in deterministic mode. */
+constexpr size_t DeterministicChunk = 8192;
+
+/**
+ * Helper method that runs an assignment pass in parallel and reduces
+ * the per-centroid sums.  The points are split into ranges, and each
+ * range is processed by \c rangeOp with a thread-local CentroidSums.
+ * The local sums are then merged into \c sums.
+ *
+ * In deterministic mode the points are split into fixed-size chunks
+ * (independent of the number of threads) and the per-chunk sums are
+ * merged in chunk order.  Otherwise each thread processes one
+ * contiguous range and the merge order is arbitrary.
+ *
+ * \param[in] n The number of points.
+ *
+ * \param[in,out] sums The sums to be computed. It must have been
+ * reset to the number of centroids and dimensions.
+ *
+ * \param[in] opts The threads and reduction mode to be used.
+ *
+ * \param[in] rangeOp The operation called as rangeOp(begin, end,
+ * localSums) for each range of points.  It returns the number of
+ * point-centroid distances it computed.
+ *
+ * \return The total number of distances computed by all the ranges.
+ */
+template<typename RangeOp>
+long reduceRanges(const size_t n, CentroidSums& sums,
+                  const LloydOptions& opts, const RangeOp& rangeOp) {
+    const CentroidSums zero = sums;
+    long distCount = 0;
+
+    if (opts.deterministic) {
+        // Each chunk has its own sums, merged below in chunk order.
+        const long chunks = (n + DeterministicChunk - 1) / DeterministicChunk;
+        std::vector<CentroidSums> partial(chunks, zero);
+        #pragma omp parallel for schedule(static) \
+            num_threads(threadCount(opts)) reduction(+:distCount)
+        for (long chunk = 0; chunk < chunks; chunk++) {
+            const size_t begin = chunk * DeterministicChunk;
+            const size_t end   = std::min(begin + DeterministicChunk, n);
+            distCount += rangeOp(begin, end, partial[chunk]);
+        }
+        for (const auto& part : partial) {
+            sums.merge(part);
+        }
+        return distCount;
+    }
+
+    // Each thread accumulates a contiguous range of points into its
+    // own sums which are then added to the shared sums.
+    #pragma omp parallel num_threads(threadCount(opts)) \
+        reduction(+:distCount)
+    {
+        CentroidSums local = zero;
+#ifdef _OPENMP
+        const size_t tid = omp_get_thread_num(), nthr = omp_get_num_threads();
+#else
+        const size_t tid = 0, nthr = 1;
+#endif
+        distCount += rangeOp(n * tid / nthr, n * (tid + 1) / nthr, local);
+        #pragma omp critical
+        sums.merge(local);
+    }
+    return distCount;
+}
+
+/**
+ * Checks if the previous and current centroids are the same.
+ *
+ * \param[in] prevCentroids The old PointList of centroids.
+ *
+ * \param[in] centroids The new PointList of centroids.
+ *
+ * \return true if they are the same and false otherwise
+ */
+bool centroidsSame(const PointList& prevCentroids, const PointList& centroids);
+
+/**
+ * Checks if the iterations have converged, based on opts.tolerance
+ * and opts.changedTolerance.
+ *
+ * \param[in] prevCentroids The centroids before the last update.
+ *
+ * \param[in] centroids The centroids after the last update.
+ *
+ * \param[in] changed The number of points assigned to a different
+ * centroid in the last iteration, or -1 if it is not known.
+ *
+ * \param[in] opts The convergence tolerances.
+ *
+ * \return true if the iterations should stop.
+ */
+bool converged(const PointList& prevCentroids, const PointList& centroids,
+               const long changed, const LloydOptions& opts);
+
+/**
+ * Runs one Lloyd iteration in parallel.  Each thread assigns a range
+ * of points to their closest centroid and accumulates them into its
+ * own CentroidSums in the same pass.  The per-thread sums are then
+ * reduced into \c sums.
+ *
+ * See reduceRanges() for the deterministic reduction mode.
+ *
+ * \param[in] points The points being clustered.
+ *
+ * \param[in] table The current centroids.
+ *
+ * \param[out] clsIdx The index of the closest centroid for each
+ * point.  It must have one entry for each point.
+ *
+ * \param[out] sums The reduced per-centroid sums and counts.
+ *
+ * \param[in] opts The threads and reduction mode to be used.
+ *
+ * \return The number of point-centroid distances computed.
+ */
+template<typename Real>
+long lloydStep(const BasicPointArray<Real>& points,
+               const BasicCentroidTable<Real>& table, IntVec& clsIdx,
+               CentroidSums& sums, const LloydOptions& opts);
+
+/**
+ * Runs one Lloyd iteration that updates the sums from the previous
+ * iteration instead of recomputing them.  Each point that is assigned
+ * to a different centroid is subtracted from its old centroid's sums
+ * and added to the new one's, so updating the sums costs time
+ * proportional to the number of changed points.
+ *
+ * \param[in] points The points being clustered.
+ *
+ * \param[in] table The current centroids.
+ *
+ * \param[in,out] clsIdx The index of the closest centroid for each
+ * point, from the previous iteration.  It is updated.
+ *
+ * \param[in,out] sums The per-centroid sums for clsIdx.  They are
+ * updated.
+ *
+ * \param[in] opts The threads and reduction mode to be used.
+ *
+ * \param[out] changed The number of points assigned to a different
+ * centroid.
+ *
+ * \return The number of point-centroid distances computed.
+ */
+template<typename Real>
+long lloydUpdate(const BasicPointArray<Real>& points,
+                 const BasicCentroidTable<Real>& table, IntVec& clsIdx,
+                 CentroidSums& sums, const LloydOptions& opts, long& changed);
+
+/**
+ * Runs Lloyd iterations until they converge (see converged()) or the
+ * maximum number of iterations is reached.  After the first
+ * iteration the sums are updated using lloydUpdate().  The methods
+ * are defined for double (PointArray) and float (PointArrayF) points;
+ * the centroids and their sums are always in double.  If opts.accel
+ * is set (only supported for double),
+ * this method uses elkanKmeans(), hamerlyKmeans(), or kdTreeKmeans()
+ * instead.
+ *
+ * \param[in] points The points being clustered.
+ *
+ * \param[in,out] centroids The initial centroids.  They are updated
+ * to the final centroids.
+ *
+ * \param[in] opts The options controlling the iterations.
+ *
+ * \param[out] iterations If not null, the number of iterations run
+ * is stored here.
+ *
+ * \param[out] distCount If not null, the number of point-centroid
+ * distances computed is stored here.
+ *
+ * \return The index of the centroid closest to each corresponding point.
+ */
+template<typename Real>
+IntVec setClosestCentroid(const BasicPointArray<Real>& points,
+                          PointList& centroids, const LloydOptions& opts = {},
+                          int* iterations = nullptr,
+                          long* distCount = nullptr);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MAPPED_POINTS_CPP
+#define MAPPED_POINTS_CPP
+
+/**
+ * Out-of-core k-means over a memory-mapped binary point file.  See
+ * MappedPoints.h for details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "MappedPoints.h"
+#include "PointStream.h"
+#include "CentroidTable.h"
+
+/** The number of points assigned at a time by each thread. */
+constexpr size_t MappedChunk = 8192;
+
+/** The number of chunks that are requested ahead of the current one. */
+constexpr size_t PrefetchChunks = 4;
+
+MappedPointFile::MappedPointFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Error opening file " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        length = st.st_size;
+        base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // The mapping stays valid after the file is closed.
+    close(fd);
+    if ((base == nullptr) || (base == MAP_FAILED)) {
+        base = nullptr;
+        throw std::runtime_error("Error mapping file " + path);
+    }
+    PointFileHeader hdr;
+    std::memcpy(&hdr, base, std::min(length, sizeof(hdr)));
+    if ((length < sizeof(hdr)) ||
+        (std::memcmp(hdr.magic, PointFileHeader().magic, 4) != 0) ||
+        (hdr.version != PointFileHeader().version) || (hdr.byteOrder != 1) ||
+        (hdr.dataOffset + hdr.count * hdr.dims * sizeof(double) > length)) {
+        munmap(base, length);
+        throw std::runtime_error(path + " is not a valid binary point file");
+    }
+    view = PointArray(reinterpret_cast<const double*>(
+                          static_cast<const char*>(base) + hdr.dataOffset),
+                      hdr.count, hdr.dims);
+    // The points are read front to back in each iteration.
+    madvise(base, length, MADV_SEQUENTIAL);
+}
+
+MappedPointFile::~MappedPointFile() {
+    munmap(base, length);
+}
+
+void
+MappedPointFile::willNeed(size_t begin, size_t end) const {
+    end = std::min(end, view.size());
+    if (begin >= end) {
+        return;
+    }
+    // madvise needs an address aligned to a page.
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t first = reinterpret_cast<uintptr_t>(view[begin]);
+    const uintptr_t last  = reinterpret_cast<uintptr_t>(view[end]);
+    const uintptr_t start = first / page * page;
+    madvise(reinterpret_cast<void*>(start), last - start, MADV_WILLNEED);
+}
+
+int mappedKmeans(const MappedPointFile& file, PointList& centroids,
+                 const LloydOptions& opts, long* distCount) {
+    const PointArray& points = file.points();
+    CentroidTable table;
+    CentroidSums sums;
+    int iteration = 0;
+    long distances = 0;
+    while (iteration < opts.maxIterations) {
+        table.load(centroids);
+        sums.reset(table.size(), table.dims());
+        distances += reduceRanges(points.size(), sums, opts,
+                                  [&](size_t begin, size_t end,
+                                      CentroidSums& local) {
+            std::vector<int> idx(MappedChunk);
+            file.willNeed(begin, std::min(begin + PrefetchChunks *
+                                          MappedChunk, end));
+            for (size_t chunk = begin; (chunk < end); chunk += MappedChunk) {
+                // Ask for a chunk ahead while this one is assigned.
+                const size_t ahead = chunk + PrefetchChunks * MappedChunk;
+                file.willNeed(ahead, std::min(ahead + MappedChunk, end));
+                const size_t last = std::min(chunk + MappedChunk, end);
+                table.nearest(points, chunk, last, idx.data());
+                for (size_t i = chunk; (i < last); i++) {
+                    local.add(idx[i - chunk], points[i]);
+                }
+            }
+            return long(end - begin) * table.size();
+        });
+        iteration++;
+        // move each centroid to the mean of its points
+        const PointList prevCentroids = centroids;
+        for (size_t c = 0; (c < centroids.size()); c++) {
+            sums.computeNewCentroid(c, centroids[c]);
+        }
+        if (converged(prevCentroids, centroids, -1, opts)) {
+            break;
+        }
+    }
+    if (distCount != nullptr) {
+        *distCount = distances;
+    }
+    return iteration;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MAPPED_POINTS_H
+#define MAPPED_POINTS_H
+
+/**
+ * Out-of-core k-means over a memory-mapped binary point file.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <string>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+
+/**
+ * A binary point file (see PointStream.h) mapped into memory.  The
+ * points are used in-place through a PointArray view, so the file
+ * can be larger than the available memory: the operating system
+ * pages the points in as they are read and can drop them again.
+ */
+class MappedPointFile {
+public:
+    /**
+     * Maps a binary point file into memory (read-only).
+     *
+     * \param[in] path The path to the binary point file.  If the file
+     * cannot be opened or mapped, or is not a binary point file, this
+     * constructor throws an exception.
+     */
+    explicit MappedPointFile(const std::string& path);
+
+    /** Unmaps the file. */
+    ~MappedPointFile();
+
+    // A mapping cannot be copied.
+    MappedPointFile(const MappedPointFile&) = delete;
+    MappedPointFile& operator=(const MappedPointFile&) = delete;
+
+    /**
+     * Returns a read-only view of the points in the file.
+     */
+    const PointArray& points() const { return view; }
+
+    /**
+     * Hints to the operating system that a range of points will be
+     * read soon, so that it can start reading them from disk.
+     *
+     * \param[in] begin The index of the first point in the range.
+     *
+     * \param[in] end One past the index of the last point.
+     */
+    void willNeed(size_t begin, size_t end) const;
+
+private:
+    /// The start of the mapping (the header of the file).
+    void* base = nullptr;
+    /// The number of bytes mapped.
+    size_t length = 0;
+    /// The view of the points in the mapping.
+    PointArray view;
+};
+
+/**
+ * Runs Lloyd iterations over a memory-mapped point file.  Each
+ * iteration is one sequential pass over the file: each thread streams
+ * through a contiguous range of points, a chunk at a time, and hints
+ * the operating system to read the next few chunks ahead.  The
+ * assignments are not stored (that would need memory proportional to
+ * the number of points), so the sums are recomputed each iteration
+ * and the accelerated algorithms are not used.  Only the centroids
+ * and the per-thread sums are kept in memory.
+ *
+ * \param[in] file The mapped point file.
+ *
+ * \param[in,out] centroids The initial centroids.  They are updated
+ * to the final centroids.
+ *
+ * \param[in] opts The options controlling the iterations.  The
+ * changedTolerance and accel options are ignored.
+ *
+ * \param[out] distCount If not null, the number of point-centroid
+ * distances computed is stored here.
+ *
+ * \return The number of iterations run.
+ */
+int mappedKmeans(const MappedPointFile& file, PointList& centroids,
+                 const LloydOptions& opts = {}, long* distCount = nullptr);
+
+#endif
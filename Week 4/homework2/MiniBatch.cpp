@@ -0,0 +1,105 @@
+#ifndef MINI_BATCH_CPP
+#define MINI_BATCH_CPP
+
+/**
+ * Mini-batch k-means.  See MiniBatch.h for details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "MiniBatch.h"
+#include "CentroidTable.h"
+
+PointList miniBatchKmeans(PointStream& stream, const int numCentroids,
+                          const MiniBatchOptions& opts) {
+    const int dims = stream.dims();
+    const size_t bufSize = opts.batchSize * opts.bufferBatches;
+    std::default_random_engine rng(opts.seeding.seed);
+
+    // Read the first buffer of points and pick initial centroids.
+    stream.rewind();
+    PointArray buffer;
+    if (stream.read(buffer, bufSize) == 0) {
+        return {};
+    }
+    // If the whole file fits in one buffer, it is never re-read.
+    const bool wholeFile = (buffer.size() < bufSize);
+    PointList centroids = initCentroids(buffer, numCentroids, opts.seeding);
+
+    // The shuffled order in which points in the buffer are used.
+    std::vector<size_t> order(buffer.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+    size_t used = 0;
+
+    // The number of points that have moved each centroid.
+    std::vector<long> counts(numCentroids, 0);
+    CentroidTable table;
+    PointArray batch(opts.batchSize, dims);
+    IntVec idx(opts.batchSize);
+    for (int b = 0; (b < opts.batches); b++) {
+        // Fill the batch, refilling the buffer as needed.
+        size_t count = 0;
+        while (count < opts.batchSize) {
+            if (used == order.size()) {
+                if (!wholeFile) {
+                    if (stream.read(buffer, bufSize) == 0) {
+                        stream.rewind();
+                        stream.read(buffer, bufSize);
+                    }
+                    order.resize(buffer.size());
+                    std::iota(order.begin(), order.end(), 0);
+                }
+                std::shuffle(order.begin(), order.end(), rng);
+                used = 0;
+            }
+            const double* pt = buffer[order[used++]];
+            std::copy_n(pt, dims, batch[count++]);
+        }
+        // Assign the batch to the centroids at the start of the batch,
+        // then move each centroid towards its points.
+        table.load(centroids);
+        table.nearest(batch, 0, count, idx.data());
+        for (size_t i = 0; (i < count); i++) {
+            const int c = idx[i];
+            const double eta = 1.0 / ++counts[c];
+            const double* pt = batch[i];
+            for (int d = 0; (d < dims); d++) {
+                centroids[c][d] += eta * (pt[d] - centroids[c][d]);
+            }
+        }
+    }
+    return centroids;
+}
+
+void writeResults(PointStream& stream, const PointList& centroids,
+                  std::ostream& os) {
+    os << "#PointType\tCentroidIndex\tCoordinates\n";
+    // Assign and print the points one chunk at a time.
+    constexpr size_t ChunkSize = 8192;
+    const CentroidTable table(centroids);
+    PointArray chunk;
+    IntVec idx(ChunkSize);
+    std::vector<double> distSq(ChunkSize);
+    double totDist = 0;
+    stream.rewind();
+    while (stream.read(chunk, ChunkSize) > 0) {
+        table.nearest(chunk, 0, chunk.size(), idx.data(), distSq.data());
+        for (size_t i = 0; (i < chunk.size()); i++) {
+            os << "1\t" << idx[i] << '\t' << chunk.point(i) << '\n';
+            totDist += std::sqrt(distSq[i]);
+        }
+    }
+    // Print each centroid followed by the total distance.
+    for (size_t i = 0; (i < centroids.size()); i++) {
+        os << "7\t" << i << '\t' << centroids.at(i) << '\n';
+    }
+    os << "# Total distance measure: " << totDist << std::endl;
+}
+
+#endif
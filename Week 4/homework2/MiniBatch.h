@@ -0,0 +1,78 @@
+#ifndef MINI_BATCH_H
+#define MINI_BATCH_H
+
+/**
+ * Mini-batch k-means (Sculley, "Web-scale k-means clustering", 2010)
+ * for datasets that are too large for full Lloyd iterations.
+ *
+ * Instead of assigning every point in each iteration, each iteration
+ * assigns a small random batch of points and nudges their centroids
+ * towards them.  Each centroid has its own learning rate, 1/count,
+ * where count is the number of points that have moved it so far.
+ * This makes each centroid the running mean of the points it has
+ * seen.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <iostream>
+#include "Kmeans.h"
+#include "PointStream.h"
+#include "Seeding.h"
+
+/**
+ * The options that control mini-batch k-means.
+ */
+struct MiniBatchOptions {
+    /// The number of points in each batch.
+    size_t batchSize = 1024;
+
+    /// The number of batches to be processed.
+    int batches = 100;
+
+    /// The points are read in buffers of these many batches.  The
+    /// points in each buffer are shuffled and then split into batches
+    /// so that batches are not biased by the order in the file.
+    int bufferBatches = 64;
+
+    /// How the initial centroids are picked from the first buffer.
+    /// The seed is also used to shuffle the points.
+    SeedOptions seeding;
+};
+
+/**
+ * Runs mini-batch k-means over the points in a stream.  The stream is
+ * read one buffer at a time and is rewound when it ends, so only
+ * bufferBatches * batchSize points are held in memory.
+ *
+ * \param[in,out] stream The stream of points to be clustered.
+ *
+ * \param[in] numCentroids The number of centroids to be computed.
+ * The initial centroids are picked from the first buffer of points
+ * using initCentroids().
+ *
+ * \param[in] opts The options controlling the batches.
+ *
+ * \return The final centroids.
+ */
+PointList miniBatchKmeans(PointStream& stream, const int numCentroids,
+                          const MiniBatchOptions& opts = {});
+
+/**
+ * Writes results in the same format as writeResults() in Kmeans.h,
+ * but reads the points from a stream.  Each point is assigned to its
+ * closest centroid as it is written.
+ *
+ * \param[in,out] stream The stream of points.  It is rewound and
+ * read once.
+ *
+ * \param[in] centroids The centroids to which the points are to be
+ * assigned.
+ *
+ * \param[out] os The output stream to where the data should be
+ * written as a TSV.
+ */
+void writeResults(PointStream& stream, const PointList& centroids,
+                  std::ostream& os = std::cout);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef MULTI_RUN_CPP
+#define MULTI_RUN_CPP
+
+/**
+ * Random restarts and k sweeps.  See MultiRun.h for details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include "MultiRun.h"
+
+template<typename Real>
+std::vector<RunResult> multiRun(const BasicPointArray<Real>& points,
+                                const MultiRunOptions& opts) {
+    const int ks = std::max(opts.maxK - opts.minK + 1, 0);
+    const int runs = ks * opts.restarts;
+    std::vector<RunResult> best(ks);
+    std::vector<double> totals(ks, 0);
+    // The runs are the thread pool's tasks, so each run is serial.
+    LloydOptions lloyd = opts.lloyd;
+    lloyd.threads = 1;
+    SeedOptions seeding = opts.seeding;
+    seeding.threads = 1;
+    #pragma omp parallel for schedule(dynamic) \
+        num_threads(threadCount(opts.lloyd))
+    for (int run = 0; run < runs; run++) {
+        // Start the runs with the largest k first, as they take longest.
+        const int ki = ks - 1 - run / opts.restarts;
+        RunResult result;
+        result.k       = opts.minK + ki;
+        result.restart = run % opts.restarts;
+        SeedOptions seed = seeding;
+        seed.seed += result.restart;
+        result.centroids = initCentroids(points, result.k, seed);
+        result.clsIdx    = setClosestCentroid(points, result.centroids, lloyd,
+                                              &result.iterations);
+        result.totDist   = getTotDist(points, result.centroids, result.clsIdx);
+        #pragma omp critical
+        {
+            RunResult& cur = best[ki];
+            totals[ki] += result.totDist;
+            if ((cur.k == 0) || (result.totDist < cur.totDist) ||
+                ((result.totDist == cur.totDist) &&
+                 (result.restart < cur.restart))) {
+                cur = std::move(result);
+            }
+        }
+    }
+    for (int ki = 0; (ki < ks); ki++) {
+        best[ki].meanTotDist = totals[ki] / opts.restarts;
+    }
+    return best;
+}
+
+// The versions of multiRun() for the supported precisions.
+template std::vector<RunResult> multiRun(const PointArray&,
+                                         const MultiRunOptions&);
+template std::vector<RunResult> multiRun(const PointArrayF&,
+                                         const MultiRunOptions&);
+
+size_t elbowIndex(const std::vector<RunResult>& results) {
+    if (results.size() < 3) {
+        return results.empty() ? 0 : results.size() - 1;
+    }
+    const double k0 = results.front().k, k1 = results.back().k;
+    const double d0 = results.front().totDist, d1 = results.back().totDist;
+    size_t elbow = results.size() - 1;
+    double farthest = 0;
+    for (size_t i = 0; (i < results.size()); i++) {
+        // Scale both axes to [0, 1] so the units do not matter.  The
+        // line from the first to the last result is then x + y = 1.
+        const double x = (results[i].k - k0) / (k1 - k0);
+        const double y = (d0 == d1) ? 0 :
+            (results[i].totDist - d1) / (d0 - d1);
+        const double below = 1 - x - y;
+        if (below > farthest) {
+            farthest = below;
+            elbow    = i;
+        }
+    }
+    return elbow;
+}
+
+void writeElbow(const std::vector<RunResult>& results, std::ostream& os) {
+    os << "#k\tBestTotDist\tMeanTotDist\tBestRestart\tIterations\n";
+    for (const auto& res : results) {
+        os << res.k << '\t' << res.totDist << '\t' << res.meanTotDist << '\t'
+           << res.restart << '\t' << res.iterations << '\n';
+    }
+}
+
+#endif
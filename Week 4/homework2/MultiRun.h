@@ -0,0 +1,100 @@
+#ifndef MULTI_RUN_H
+#define MULTI_RUN_H
+
+/**
+ * Runs k-means many times on the same points -- several random
+ * restarts for each of a range of k values -- to pick a good
+ * clustering in one invocation.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <iostream>
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+#include "Seeding.h"
+
+/**
+ * The options that control the runs.
+ */
+struct MultiRunOptions {
+    /// The number of restarts (with different seeds) for each k.
+    int restarts = 1;
+
+    /// The smallest and largest number of centroids to be tried.
+    int minK = 1, maxK = 1;
+
+    /// The options for each run.  Here lloyd.threads is the number
+    /// of runs executed concurrently; each run uses a single thread.
+    LloydOptions lloyd;
+
+    /// The seeding options for each run.  Restart r uses the seed
+    /// seeding.seed + r, for every k, so the results do not depend
+    /// on the order in which runs finish.
+    SeedOptions seeding;
+};
+
+/**
+ * The best run for one value of k.
+ */
+struct RunResult {
+    /// The number of centroids.
+    int k = 0;
+    /// The restart (0 to restarts - 1) that gave this result.
+    int restart = 0;
+    /// The total distance of the points from their centroids, as
+    /// computed by getTotDist().
+    double totDist = 0;
+    /// The average total distance over all the restarts.
+    double meanTotDist = 0;
+    /// The number of iterations run.
+    int iterations = 0;
+    /// The final centroids.
+    PointList centroids;
+    /// The index of the centroid for each point.
+    IntVec clsIdx;
+};
+
+/**
+ * Runs restarts * (maxK - minK + 1) k-means runs on a pool of
+ * threads.  All the runs read the same points; they are never copied.
+ * Each run is scored using getTotDist() and only the best restart
+ * for each k is retained.  Ties go to the lower restart number.  It
+ * is defined for PointArray and PointArrayF points.
+ *
+ * \param[in] points The points to be clustered.
+ *
+ * \param[in] opts The options controlling the runs.
+ *
+ * \return The best run for each k, in increasing order of k.
+ */
+template<typename Real>
+std::vector<RunResult> multiRun(const BasicPointArray<Real>& points,
+                                const MultiRunOptions& opts);
+
+/**
+ * Picks the "elbow" of the curve of total distance versus k: the
+ * result farthest below the straight line joining the first and last
+ * results (with both axes scaled to [0, 1]).  Beyond this point,
+ * adding centroids reduces the total distance much less.
+ *
+ * \param[in] results The best run for each k, in increasing order
+ * of k, as returned by multiRun().
+ *
+ * \return The index of the chosen result.
+ */
+size_t elbowIndex(const std::vector<RunResult>& results);
+
+/**
+ * Prints the elbow curve as a TSV with one line per k.
+ *
+ * \param[in] results The best run for each k.
+ *
+ * \param[out] os The output stream to where the curve is written.
+ */
+void writeElbow(const std::vector<RunResult>& results,
+                std::ostream& os = std::cerr);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef ONLINE_KMEANS_CPP
+#define ONLINE_KMEANS_CPP
+
+/**
+ * Online k-means over a stream of points.  See OnlineKmeans.h for
+ * details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "OnlineKmeans.h"
+#include "PointStream.h"
+
+PointList onlineKmeans(std::istream& is, const int numCols,
+                       const int numCentroids, const OnlineOptions& opts,
+                       std::ostream& os, const std::string& name) {
+    if (!(opts.decay > 0) || (opts.decay > 1)) {
+        throw std::invalid_argument("The decay must be in (0, 1]");
+    }
+    using Clock = std::chrono::steady_clock;
+    const std::chrono::duration<double> interval(opts.snapshotSeconds);
+    auto lastSnapshot = Clock::now();
+    long snapshotted = -1;
+    // The centroids (k x numCols, row-major) and their weights.
+    std::vector<double> centers;
+    centers.reserve(size_t(numCentroids) * numCols);
+    std::vector<double> weights;
+    std::vector<double> pt(numCols);
+    auto current = [&]() {
+        PointList centroids(weights.size(), Point(numCols));
+        for (size_t c = 0; (c < weights.size()); c++) {
+            std::copy_n(&centers[c * numCols], numCols,
+                        std::begin(centroids[c]));
+        }
+        return centroids;
+    };
+    std::string line;
+    long lineNum = 0, points = 0;
+    while (std::getline(is, line)) {
+        lineNum++;
+        // Skip empty lines and comments.
+        if (!line.empty() && (line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        try {
+            parsePoint(line.data(), line.data() + line.size(), numCols,
+                       pt.data());
+        } catch (const std::invalid_argument& e) {
+            throw std::invalid_argument(name + ":" + std::to_string(lineNum) +
+                                        ": " + e.what());
+        }
+        points++;
+        // Find the closest centroid.
+        int closest = -1;
+        double smallest = std::numeric_limits<double>::infinity();
+        for (size_t c = 0; (c < weights.size()); c++) {
+            const double* center = &centers[c * numCols];
+            double dist = 0;
+            for (int d = 0; (d < numCols); d++) {
+                const double diff = pt[d] - center[d];
+                dist += diff * diff;
+            }
+            if (dist < smallest) {
+                smallest = dist;
+                closest = c;
+            }
+        }
+        if ((int(weights.size()) < numCentroids) && (smallest > 0)) {
+            // The first distinct points become the centroids.
+            centers.insert(centers.end(), pt.begin(), pt.end());
+            weights.push_back(1);
+        } else {
+            // Move the closest centroid towards the point.
+            weights[closest] = opts.decay * weights[closest] + 1;
+            const double eta = 1 / weights[closest];
+            double* center = &centers[closest * numCols];
+            for (int d = 0; (d < numCols); d++) {
+                center[d] += eta * (pt[d] - center[d]);
+            }
+        }
+        if (((opts.snapshotPoints > 0) &&
+             (points % opts.snapshotPoints == 0)) ||
+            ((opts.snapshotSeconds > 0) &&
+             (Clock::now() - lastSnapshot >= interval))) {
+            writeCentroids(current(), points, os);
+            lastSnapshot = Clock::now();
+            snapshotted  = points;
+        }
+    }
+    // Write the final centroids unless they were just written.
+    const PointList centroids = current();
+    if (snapshotted != points) {
+        writeCentroids(centroids, points, os);
+    }
+    return centroids;
+}
+
+void writeCentroids(const PointList& centroids, const long points,
+                    std::ostream& os) {
+    os << "# Points: " << points << '\n';
+    for (size_t i = 0; (i < centroids.size()); i++) {
+        os << "7\t" << i << '\t';
+        for (const auto v : centroids[i]) {
+            os << v << '\t';
+        }
+        os << '\n';
+    }
+    os.flush();
+}
+
+#endif
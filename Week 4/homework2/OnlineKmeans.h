@@ -0,0 +1,98 @@
+#ifndef ONLINE_KMEANS_H
+#define ONLINE_KMEANS_H
+
+/**
+ * Online (sequential) k-means over a stream of points that may never
+ * end, such as points piped to standard input.
+ *
+ * The first k distinct points become the initial centroids.  Each
+ * later point moves only its closest centroid towards it
+ * (MacQueen, "Some methods for classification and analysis of
+ * multivariate observations", 1967):
+ *
+ *   w(c) = decay * w(c) + 1,   c = c + (x - c) / w(c)
+ *
+ * With a decay of 1, w(c) counts the points that have moved c and
+ * each centroid is the running mean of its points.  With a decay
+ * below 1, the weight of the older points fades, so the centroids
+ * follow data whose clusters drift: the learning rate settles at
+ * 1 - decay, i.e., each centroid mostly reflects its last
+ * 1 / (1 - decay) points.
+ *
+ * Only the centroids and their weights are kept, so the memory used
+ * is O(k d) however long the stream runs.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <iostream>
+#include <string>
+#include "Kmeans.h"
+
+/**
+ * The options that control online k-means.
+ */
+struct OnlineOptions {
+    /// The factor (in (0, 1]) by which the weight of a centroid is
+    /// multiplied before each point is added.  1 gives MacQueen's
+    /// running means.
+    double decay = 1;
+
+    /// If not zero, the centroids are written after every these many
+    /// points.
+    long snapshotPoints = 0;
+
+    /// If not zero, the centroids are written when at least these
+    /// many seconds have passed since the last snapshot.  The clock
+    /// is checked as points arrive, so an idle stream is not
+    /// snapshotted.
+    double snapshotSeconds = 0;
+};
+
+/**
+ * Clusters the points read from a stream until it ends.  The lines
+ * are read like a TSV file in PointStream: blank lines and lines
+ * starting with '#' are skipped, and the first numCols columns of
+ * each line are used.
+ *
+ * \param[in,out] is The stream of points, e.g., std::cin.
+ *
+ * \param[in] numCols The number of columns to be used.
+ *
+ * \param[in] numCentroids The number of centroids.  If the stream
+ * has fewer distinct points, fewer centroids are returned.
+ *
+ * \param[in] opts The decay and the snapshot intervals.
+ *
+ * \param[out] os The stream to which the snapshots (see
+ * writeCentroids()) are written.  A final snapshot is written when
+ * the input ends.
+ *
+ * \param[in] name The name of the input used in error messages.  A
+ * line that cannot be parsed results in a std::invalid_argument
+ * exception with the message "name:line: reason".
+ *
+ * \return The final centroids.
+ */
+PointList onlineKmeans(std::istream& is, const int numCols,
+                       const int numCentroids, const OnlineOptions& opts = {},
+                       std::ostream& os = std::cout,
+                       const std::string& name = "stdin");
+
+/**
+ * Writes the centroids in the same format as the centroid lines
+ * from writeResults(): "7", the index, and the coordinates, separated
+ * by tabs.  They are preceded by a comment with the number of points
+ * seen, and the stream is flushed so that a reader on a pipe sees
+ * each snapshot as soon as it is written.
+ *
+ * \param[in] centroids The centroids to be written.
+ *
+ * \param[in] points The number of points clustered so far.
+ *
+ * \param[out] os The output stream.
+ */
+void writeCentroids(const PointList& centroids, const long points,
+                    std::ostream& os = std::cout);
+
+#endif
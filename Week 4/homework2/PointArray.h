@@ -0,0 +1,146 @@
+#ifndef POINT_ARRAY_H
+#define POINT_ARRAY_H
+
+/**
+ * A compact, contiguous storage for the points being clustered.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <vector>
+#include "Kmeans.h"
+
+/**
+ * A flat, row-major list of points.  Unlike a PointList, where each
+ * Point is its own heap allocation, all the coordinates are stored in
+ * one contiguous buffer: the coordinates of point i are at
+ * [i * dims(), (i + 1) * dims()).  This is the layout used by the
+ * performance-oriented parts of the k-means code, which can then
+ * stream through the points without chasing pointers.
+ *
+ * \tparam Real The type of each coordinate.  Storing the points as
+ * float (see PointArrayF) halves the memory and bandwidth used by the
+ * assignment passes and doubles the number of coordinates in each
+ * SIMD register.
+ *
+ * An array can also be a read-only view of coordinates stored
+ * elsewhere, such as a memory-mapped point file (see MappedPoints.h).
+ * A view does not own or copy the coordinates.
+ */
+template<typename Real>
+class BasicPointArray {
+public:
+    /**
+     * Creates an array of points with all coordinates set to zero.
+     *
+     * \param[in] count The number of points in the array.
+     *
+     * \param[in] dims The number of dimensions (coordinates) of
+     * each point.
+     */
+    explicit BasicPointArray(const size_t count = 0, const int dims = 0) :
+        count(count), dimCount(dims), coords(count * dims) {
+    }
+
+    /**
+     * Creates a read-only view of coordinates stored elsewhere.  The
+     * coordinates must outlive this array (and any copies of it), and
+     * the view must only be used through a const reference.
+     *
+     * \param[in] data The row-major coordinates of the points.
+     *
+     * \param[in] count The number of points.
+     *
+     * \param[in] dims The number of dimensions of each point.
+     */
+    BasicPointArray(const Real* data, const size_t count, const int dims) :
+        count(count), dimCount(dims), view(data) {
+    }
+
+    /**
+     * Convenience constructor to create a flat copy of a list of
+     * points.  All points in the list must have the same number of
+     * dimensions.  The coordinates are converted to Real.
+     *
+     * \param[in] pl The list of points to be copied.
+     */
+    explicit BasicPointArray(const PointList& pl) :
+        BasicPointArray(pl.size(), pl.empty() ? 0 : pl.front().size()) {
+        for (size_t i = 0; (i < count); i++) {
+            std::copy(std::begin(pl[i]), std::end(pl[i]), (*this)[i]);
+        }
+    }
+
+    /**
+     * Changes the number of points in this array.  Existing points
+     * are retained and new points are set to zero.  This method must
+     * not be used on a view.
+     *
+     * \param[in] count The new number of points.
+     */
+    void resize(const size_t count) {
+        this->count = count;
+        coords.resize(count * dimCount);
+    }
+
+    /**
+     * Returns the number of points in this array.
+     */
+    size_t size() const { return count; }
+
+    /**
+     * Returns the number of dimensions of each point.
+     */
+    int dims() const { return dimCount; }
+
+    /**
+     * Returns a pointer to the first coordinate of a given point.
+     *
+     * \param[in] i The index of the point.  No bounds checks are
+     * performed.
+     */
+    const Real* operator[](const size_t i) const {
+        return ((view != nullptr) ? view : coords.data()) + i * dimCount;
+    }
+
+    /**
+     * Returns a pointer to the first coordinate of a given point.
+     *
+     * \param[in] i The index of the point.  No bounds checks are
+     * performed.  This method must not be used on a view.
+     */
+    Real* operator[](const size_t i) {
+        return coords.data() + i * dimCount;
+    }
+
+    /**
+     * Returns a given point as a Point, for use with the helper
+     * methods in Kmeans.h.
+     *
+     * \param[in] i The index of the point to be returned.
+     */
+    Point point(const size_t i) const {
+        Point pt(dimCount);
+        std::copy_n((*this)[i], dimCount, std::begin(pt));
+        return pt;
+    }
+
+private:
+    /// The number of points in this array.
+    size_t count;
+    /// The number of coordinates in each point.
+    int dimCount;
+    /// The row-major coordinates of all the points.
+    std::vector<Real> coords;
+    /// The coordinates of a view, or nullptr if coords is used.
+    const Real* view = nullptr;
+};
+
+/** The points in double precision, used by most of the k-means code. */
+using PointArray = BasicPointArray<double>;
+
+/** The points in single precision (see the --float option). */
+using PointArrayF = BasicPointArray<float>;
+
+#endif
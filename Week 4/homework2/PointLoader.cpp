@@ -0,0 +1,157 @@
+#ifndef POINT_LOADER_CPP
+#define POINT_LOADER_CPP
+
+/**
+ * Fast loading of all the points in a TSV file.  See PointLoader.h
+ * for details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "PointLoader.h"
+#include "PointStream.h"
+#include "MappedPoints.h"
+#include "Lloyd.h"
+
+/** The smallest number of bytes in each chunk parsed by a thread. */
+constexpr size_t MinLoadChunk = 1 << 20;
+
+/**
+ * A read-only mapping of a whole file that is unmapped when it goes
+ * out of scope, even if parsing throws an exception.
+ */
+struct MappedText {
+    const char* data = nullptr;
+    size_t size = 0;
+    ~MappedText() {
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+    }
+};
+
+/**
+ * Returns one past the end of a line, excluding the newline and any
+ * carriage return, and moves pos to the start of the next line.
+ */
+static const char* nextLine(const char*& pos, const char* end) {
+    const char* line = pos;
+    const char* nl = static_cast<const char*>(std::memchr(pos, '\n',
+                                                          end - pos));
+    const char* lineEnd = (nl != nullptr) ? nl : end;
+    pos = (nl != nullptr) ? nl + 1 : end;
+    if ((lineEnd > line) && (lineEnd[-1] == '\r')) {
+        lineEnd--;
+    }
+    return lineEnd;
+}
+
+PointArray loadPoints(const std::string& path, const int numCols,
+                      const int threads) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Error opening file " + path);
+    }
+    MappedText text;
+    struct stat st = {};
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+        void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED) {
+            text.data = static_cast<const char*>(base);
+            text.size = st.st_size;
+            madvise(base, text.size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    if ((text.data == nullptr) && (st.st_size > 0)) {
+        throw std::runtime_error("Error mapping file " + path);
+    }
+    // A binary point file just needs to be copied.
+    if ((text.size >= 4) && (std::memcmp(text.data, "KMPF", 4) == 0)) {
+        const MappedPointFile file(path);
+        const PointArray& view = file.points();
+        if (view.dims() != numCols) {
+            throw std::runtime_error("Point file " + path + " has " +
+                                     std::to_string(view.dims()) +
+                                     " columns");
+        }
+        PointArray points(view.size(), numCols);
+        std::copy_n(view[0], view.size() * numCols, points[0]);
+        return points;
+    }
+
+    // Split the file into chunks of whole lines; a line belongs to
+    // the chunk in which it starts.
+    const int nThreads = threadCount(LloydOptions{0, threads});
+    const long chunks = std::max<long>(1, std::min<long>(nThreads * 8,
+                                                         text.size /
+                                                         MinLoadChunk));
+    std::vector<const char*> start(chunks + 1, text.data + text.size);
+    for (long c = 0; (c < chunks); c++) {
+        const char* pos = text.data + text.size * c / chunks;
+        if ((c > 0) && (pos[-1] != '\n')) {
+            nextLine(pos, text.data + text.size);
+        }
+        start[c] = pos;
+    }
+    auto isPoint = [](const char* line, const char* lineEnd) {
+        return (line < lineEnd) && (*line != '#');
+    };
+
+    // Count the lines and the points in each chunk.
+    std::vector<long> lines(chunks + 1, 0), counts(chunks + 1, 0);
+    #pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+    for (long c = 0; c < chunks; c++) {
+        const char* pos = start[c];
+        while (pos < start[c + 1]) {
+            const char* line = pos;
+            const char* lineEnd = nextLine(pos, start[c + 1]);
+            counts[c + 1] += isPoint(line, lineEnd);
+            lines[c + 1]++;
+        }
+    }
+    // Turn the counts into the first line and point of each chunk.
+    for (long c = 0; (c < chunks); c++) {
+        lines[c + 1]  += lines[c];
+        counts[c + 1] += counts[c];
+    }
+
+    // Parse each chunk into its part of the array.  An error is
+    // recorded with its line number and reported after the loop.
+    PointArray points(counts[chunks], numCols);
+    std::vector<std::string> errors(chunks);
+    #pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+    for (long c = 0; c < chunks; c++) {
+        const char* pos = start[c];
+        long lineNum = lines[c], i = counts[c];
+        try {
+            while (pos < start[c + 1]) {
+                const char* line = pos;
+                const char* lineEnd = nextLine(pos, start[c + 1]);
+                lineNum++;
+                if (isPoint(line, lineEnd)) {
+                    parsePoint(line, lineEnd, numCols, points[i++]);
+                }
+            }
+        } catch (const std::exception& exp) {
+            errors[c] = path + ":" + std::to_string(lineNum) + ": " +
+                exp.what();
+        }
+    }
+    for (const auto& error : errors) {
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+    return points;
+}
+
+#endif
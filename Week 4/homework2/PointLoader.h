@@ -0,0 +1,41 @@
+#ifndef POINT_LOADER_H
+#define POINT_LOADER_H
+
+/**
+ * Fast loading of all the points in a TSV file into a PointArray.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <string>
+#include "PointArray.h"
+
+/**
+ * Loads the points in a TSV file (or a binary point file, see
+ * PointStream.h) into a PointArray.
+ *
+ * The file is memory-mapped and split into chunks of whole lines
+ * that are parsed in parallel.  A first pass counts the points in
+ * each chunk, so that the second pass can parse each line (see
+ * parsePoint()) straight into its place in the array.  As with
+ * PointStream, blank lines and lines starting with '#' are skipped
+ * and the first numCols columns of each line are used.
+ *
+ * \param[in] path The path to the TSV or binary point file.
+ *
+ * \param[in] numCols The number of columns to be used.  For binary
+ * files this value must match the dimensions in the file.
+ *
+ * \param[in] threads The number of threads to be used.  Zero uses
+ * the OpenMP default.
+ *
+ * \return The points in the file, in the order in which they appear.
+ *
+ * \exception std::runtime_error If the file cannot be read or a line
+ * cannot be parsed.  For a bad line, the message has the form
+ * "path:line: reason", where line is the 1-based line number.
+ */
+PointArray loadPoints(const std::string& path, const int numCols,
+                      const int threads = 0);
+
+#endif
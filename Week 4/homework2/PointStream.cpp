@@ -0,0 +1,178 @@
+#ifndef POINT_STREAM_CPP
+#define POINT_STREAM_CPP
+
+/**
+ * Sequential, batch-at-a-time reading of points from a TSV file or
+ * a binary point file.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "PointStream.h"
+
+/**
+ * Returns true for the characters that separate the columns of a TSV
+ * file (the whitespace skipped by operator>>).
+ */
+static bool isSeparator(const char c) {
+    return (c == '\t') || (c == ' ') || (c == '\r') || (c == '\v') ||
+        (c == '\f') || (c == '\n');
+}
+
+void parsePoint(const char* begin, const char* end, const int numCols,
+                double* pt) {
+    const char* pos = begin;
+    for (int i = 0; (i < numCols); i++) {
+        while ((pos < end) && isSeparator(*pos)) {
+            pos++;
+        }
+        if (pos == end) {
+            throw std::invalid_argument("expected " + std::to_string(numCols) +
+                                        " columns but found " +
+                                        std::to_string(i));
+        }
+        // A quoted number must end at the closing quote.  Otherwise
+        // the number must end at a separator or the end of the line.
+        const bool quoted = (*pos == '"');
+        const char* first = pos + quoted;
+        const char* last  = quoted ? std::find(first, end, '"') : end;
+        // from_chars does not accept a leading '+' (but stod did).
+        const char* digits = ((first < last) && (*first == '+')) ? first + 1 :
+            first;
+        const auto result = std::from_chars(digits, last, pt[i]);
+        pos = result.ptr;
+        if ((result.ec != std::errc()) || (digits == last) ||
+            (quoted ? (pos != last) : ((pos < end) && !isSeparator(*pos)))) {
+            // Report the whole column.
+            const char* stop = first;
+            while ((stop < end) && !isSeparator(*stop) && (*stop != '"')) {
+                stop++;
+            }
+            throw std::invalid_argument("invalid number '" +
+                                        std::string(first, stop) +
+                                        "' in column " + std::to_string(i + 1));
+        }
+        pos += quoted;
+    }
+}
+
+PointStream::PointStream(const std::string& path, const int numCols,
+                         const int part, const int parts) :
+    path(path), is(path, std::ios::binary), numCols(numCols) {
+    if (!is.good()) {
+        throw std::runtime_error("Error opening file " + path);
+    }
+    // Check the magic bytes to detect binary point files.
+    PointFileHeader hdr;
+    if (is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) &&
+        (std::memcmp(hdr.magic, header.magic, sizeof(hdr.magic)) == 0)) {
+        if ((hdr.version != header.version) || (hdr.byteOrder != 1)) {
+            throw std::runtime_error("Unsupported point file " + path);
+        }
+        if ((numCols != 0) && (numCols != int(hdr.dims))) {
+            throw std::runtime_error("Point file " + path + " has " +
+                                     std::to_string(hdr.dims) + " columns");
+        }
+        header = hdr;
+        binary = true;
+        this->numCols = hdr.dims;
+    }
+    // Compute the range of points (binary) or bytes (TSV) in this part.
+    is.clear();
+    is.seekg(0, std::ios::end);
+    const uint64_t size = binary ? header.count : uint64_t(is.tellg());
+    begin = size * part / parts;
+    end   = size * (part + 1) / parts;
+    rewind();
+}
+
+void
+PointStream::rewind() {
+    is.clear();
+    if (binary) {
+        is.seekg(header.dataOffset + begin * numCols * sizeof(double));
+        position = begin;
+    } else if (begin == 0) {
+        is.seekg(0);
+        position = 0;
+    } else {
+        // The line that straddles the beginning of this part belongs
+        // to the previous part.  So skip to the start of the next line.
+        std::string line;
+        is.seekg(begin - 1);
+        std::getline(is, line);
+        position = begin + line.size();
+    }
+}
+
+size_t
+PointStream::read(PointArray& batch, const size_t maxCount) {
+    if (batch.dims() != numCols) {
+        batch = PointArray(0, numCols);
+    }
+    batch.resize(maxCount);
+    size_t count = 0;
+    if (binary) {
+        // The points are stored contiguously just like in PointArray.
+        count = std::min<uint64_t>(maxCount, end - position);
+        const std::streamsize bytes = count * numCols * sizeof(double);
+        if ((count > 0) &&
+            (!is.read(reinterpret_cast<char*>(batch[0]), bytes) ||
+             (is.gcount() != bytes))) {
+            throw std::runtime_error("Point file " + path + " is truncated");
+        }
+        position += count;
+    } else {
+        // The position is tracked from the lengths of the lines (plus
+        // the newline), as asking the stream for it is slow.
+        std::string line;
+        while ((count < maxCount) && (position < end) &&
+               std::getline(is, line)) {
+            position += line.size() + 1;
+            // Skip empty lines and comments.
+            if (!line.empty() && (line.back() == '\r')) {
+                line.pop_back();
+            }
+            if (line.empty() || (line[0] == '#')) {
+                continue;
+            }
+            parsePoint(line.data(), line.data() + line.size(), numCols,
+                       batch[count++]);
+        }
+    }
+    batch.resize(count);
+    return count;
+}
+
+uint64_t writePointFile(PointStream& in, const std::string& path) {
+    std::ofstream os(path, std::ios::binary);
+    if (!os.good()) {
+        throw std::runtime_error("Error creating file " + path);
+    }
+    // The header is written again at the end, once the count is known.
+    PointFileHeader hdr;
+    hdr.dims = in.dims();
+    const std::vector<char> padding(hdr.dataOffset - sizeof(hdr), 0);
+    os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    os.write(padding.data(), padding.size());
+    PointArray batch;
+    in.rewind();
+    while (in.read(batch, 8192) > 0) {
+        os.write(reinterpret_cast<const char*>(batch[0]),
+                 batch.size() * batch.dims() * sizeof(double));
+        hdr.count += batch.size();
+    }
+    os.seekp(0);
+    os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    if (!os.good()) {
+        throw std::runtime_error("Error writing file " + path);
+    }
+    return hdr.count;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef POINT_STREAM_H
+#define POINT_STREAM_H
+
+/**
+ * Sequential, batch-at-a-time reading of points from a TSV file or
+ * a binary point file.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "PointArray.h"
+
+/**
+ * The header at the beginning of a binary point file.  The header is
+ * followed (at dataOffset bytes from the beginning of the file) by
+ * count * dims doubles in row-major order, in the byte order of the
+ * machine that wrote the file.
+ */
+struct PointFileHeader {
+    /// The magic bytes that identify the file: "KMPF".
+    char magic[4] = {'K', 'M', 'P', 'F'};
+    /// The version of the file format.
+    uint32_t version = 1;
+    /// The number of points in the file.
+    uint64_t count = 0;
+    /// The number of coordinates in each point.
+    uint32_t dims = 0;
+    /// The offset (in bytes) of the first coordinate.  The data is
+    /// aligned to 64 bytes so the file can be used in-place.
+    uint32_t dataOffset = 64;
+    /// A value written as 1 to detect files from a machine with a
+    /// different byte order.
+    uint64_t byteOrder = 1;
+};
+
+/**
+ * Reads points, a batch at a time, from either a TSV file or a
+ * binary point file.  This permits processing files that are too
+ * large to be loaded into memory at once.
+ *
+ * A file is treated as a binary point file if it starts with the
+ * magic bytes in PointFileHeader.  Otherwise it is read as a TSV
+ * file, where blank lines and lines starting with '#' are skipped,
+ * and the first numCols columns of each line are used.
+ */
+class PointStream {
+public:
+    /**
+     * Opens a file of points.
+     *
+     * \param[in] path The path to the TSV or binary point file.  If
+     * the file cannot be opened, this constructor throws an exception.
+     *
+     * \param[in] numCols The number of columns to be used from a TSV
+     * file.  For binary files this value must be zero or match the
+     * dimensions in the file.
+     *
+     * \param[in] part The part (or shard) of the file to be read by
+     * this stream, in the range 0 to parts - 1.  This is used to
+     * have each process read a different part of the same file.
+     *
+     * \param[in] parts The number of parts into which the file is
+     * split.  A TSV file is split into equal byte ranges (a line
+     * belongs to the part in which it starts), while a binary file is
+     * split into equal numbers of points.  Reading all the parts in
+     * order gives all the points in the file in order.
+     */
+    PointStream(const std::string& path, const int numCols,
+                const int part = 0, const int parts = 1);
+
+    /**
+     * Reads the next batch of points.
+     *
+     * \param[out] batch The array into which points are read.  It is
+     * resized to the number of points read.
+     *
+     * \param[in] maxCount The maximum number of points to be read.
+     *
+     * \return The number of points read.  Zero indicates the end of
+     * the file.
+     */
+    size_t read(PointArray& batch, const size_t maxCount);
+
+    /**
+     * Starts reading the points from the beginning of the file again.
+     */
+    void rewind();
+
+    /**
+     * Returns the number of dimensions of each point.
+     */
+    int dims() const { return numCols; }
+
+    /**
+     * Returns true if this stream is reading a binary point file.
+     */
+    bool isBinary() const { return binary; }
+
+private:
+    /// The path of the file, used in error messages.
+    std::string path;
+    /// The file from where the points are read.
+    std::ifstream is;
+    /// The number of coordinates in each point.
+    int numCols;
+    /// True if the file is a binary point file.
+    bool binary = false;
+    /// The header read from a binary point file.
+    PointFileHeader header;
+    /// The first byte (TSV) or point (binary) in this part.
+    uint64_t begin = 0;
+    /// One past the last byte (TSV) or point (binary) in this part.
+    uint64_t end = 0;
+    /// The current byte (TSV) or point (binary) in this part.
+    uint64_t position = 0;
+};
+
+/**
+ * Parses the first numCols whitespace-separated numbers on a line of
+ * a TSV file.  The numbers are converted with std::from_chars, so no
+ * strings are created.  A number may be enclosed in double quotes.
+ * Any further columns on the line are ignored.
+ *
+ * \param[in] begin The first character of the line.
+ *
+ * \param[in] end One past the last character of the line (excluding
+ * the newline).
+ *
+ * \param[in] numCols The number of numbers to be parsed.
+ *
+ * \param[out] pt The numCols numbers are stored here.
+ *
+ * \exception std::invalid_argument If the line has fewer than numCols
+ * columns or a column is not a number.  The message says which.
+ */
+void parsePoint(const char* begin, const char* end, const int numCols,
+                double* pt);
+
+/**
+ * Writes all the points in a stream to a binary point file.  This is
+ * used to convert a TSV file once, so that later runs can read (or
+ * memory-map) the points without parsing them.
+ *
+ * \param[in,out] in The stream of points to be converted.  It is
+ * rewound and read once, a batch at a time.
+ *
+ * \param[in] path The path to the binary point file to be created.
+ * If the file cannot be written, this method throws an exception.
+ *
+ * \return The number of points written.
+ */
+uint64_t writePointFile(PointStream& in, const std::string& path);
+
+#endif
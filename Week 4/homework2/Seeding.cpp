@@ -0,0 +1,261 @@
+#ifndef SEEDING_CPP
+#define SEEDING_CPP
+
+/**
+ * Methods to pick the initial centroids for k-means.  See Seeding.h
+ * for details.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "Seeding.h"
+#include "CentroidTable.h"
+#include "Lloyd.h"
+
+/**
+ * Returns a uniform random number in [0, 1) for a given point in a
+ * given k-means|| round.  The number depends only on the arguments
+ * (it is a SplitMix64 hash), so each thread can draw the number for
+ * its points independently and the result does not depend on the
+ * number of threads.
+ */
+static double hashUniform(const unsigned seed, const int round,
+                          const size_t i) {
+    uint64_t x = (uint64_t(seed) << 32) ^ (uint64_t(round) << 48) ^ i;
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= (x >> 31);
+    return (x >> 11) * 0x1.0p-53;
+}
+
+/**
+ * Updates the squared distance from each point to its closest
+ * centroid with the distance to a new set of centroids.
+ *
+ * \param[in] data The points being clustered.
+ *
+ * \param[in] added The newly picked centroids.
+ *
+ * \param[in,out] minDist The squared distance from each point to its
+ * closest centroid.
+ *
+ * \param[in] threads The number of threads to be used.
+ */
+template<typename Real>
+static void updateMinDist(const BasicPointArray<Real>& data,
+                          const PointList& added,
+                          std::vector<double>& minDist,
+                          [[maybe_unused]] const int threads) {
+    const BasicCentroidTable<Real> table(added);
+    constexpr long Chunk = 4096;
+    const long n = data.size();
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (long begin = 0; begin < n; begin += Chunk) {
+        const long end = std::min(begin + Chunk, n);
+        int idx[Chunk];
+        Real dist[Chunk];
+        table.nearest(data, begin, end, idx, dist);
+        for (long i = begin; (i < end); i++) {
+            minDist[i] = std::min<double>(minDist[i], dist[i - begin]);
+        }
+    }
+}
+
+/**
+ * Draws the index of a point with probability proportional to
+ * weight[i] * minDist[i].  The sums are computed serially so that the
+ * result does not depend on the number of threads.
+ *
+ * \param[in] minDist The squared distance of each point to its
+ * closest centroid.
+ *
+ * \param[in] weights The weight of each point.  If empty, each point
+ * has a weight of 1.
+ *
+ * \param[in,out] rng The random number generator to be used.
+ *
+ * \return The index of the point drawn.
+ */
+static size_t drawIndex(const std::vector<double>& minDist,
+                        const std::vector<double>& weights,
+                        std::mt19937_64& rng) {
+    const size_t n = minDist.size();
+    auto w = [&](size_t i) { return weights.empty() ? 1 : weights[i]; };
+    double total = 0;
+    for (size_t i = 0; (i < n); i++) {
+        total += w(i) * minDist[i];
+    }
+    if (!(total > 0) || (total == std::numeric_limits<double>::infinity())) {
+        // All points coincide with centroids (or no centroids yet).
+        // Just pick a point based on the weights.
+        std::vector<double> wts(n);
+        for (size_t i = 0; (i < n); i++) {
+            wts[i] = w(i);
+        }
+        return std::discrete_distribution<size_t>(wts.begin(), wts.end())(rng);
+    }
+    const double target = std::uniform_real_distribution<double>(0, total)(rng);
+    double sum = 0;
+    for (size_t i = 0; (i < n); i++) {
+        sum += w(i) * minDist[i];
+        if (sum > target) {
+            return i;
+        }
+    }
+    return n - 1;
+}
+
+/**
+ * The weighted k-means++ used both for k-means++ seeding (with unit
+ * weights) and to reduce the candidates from k-means||.
+ */
+template<typename Real>
+static PointList plusPlus(const BasicPointArray<Real>& data,
+                          const std::vector<double>& weights,
+                          const int numCentroids, std::mt19937_64& rng,
+                          const int threads) {
+    std::vector<double> minDist(data.size(),
+                                std::numeric_limits<double>::infinity());
+    PointList centroids;
+    for (int c = 0; (c < numCentroids) && (c < int(data.size())); c++) {
+        centroids.push_back(data.point(drawIndex(minDist, weights, rng)));
+        updateMinDist(data, {centroids.back()}, minDist, threads);
+    }
+    return centroids;
+}
+
+template<typename Real>
+PointList kmeansPlusPlus(const BasicPointArray<Real>& data,
+                         const int numCentroids, const SeedOptions& opts) {
+    std::mt19937_64 rng(opts.seed);
+    return plusPlus(data, {}, numCentroids, rng,
+                    threadCount(LloydOptions{0, opts.threads}));
+}
+
+PointList weightedKmeansPlusPlus(const PointArray& data,
+                                 const std::vector<double>& weights,
+                                 const int numCentroids,
+                                 const SeedOptions& opts) {
+    std::mt19937_64 rng(opts.seed);
+    return plusPlus(data, weights, numCentroids, rng,
+                    threadCount(LloydOptions{0, opts.threads}));
+}
+
+template<typename Real>
+PointList kmeansParallel(const BasicPointArray<Real>& data,
+                         const int numCentroids, const SeedOptions& opts) {
+    const int threads = threadCount(LloydOptions{0, opts.threads});
+    const long n = data.size();
+    if (n == 0) {
+        return {};  // No points to pick from, as with k-means++.
+    }
+    std::mt19937_64 rng(opts.seed);
+    // Start with one uniformly random point.
+    PointList candidates = {
+        data.point(std::uniform_int_distribution<long>(0, n - 1)(rng)) };
+    std::vector<double> minDist(n, std::numeric_limits<double>::infinity());
+    updateMinDist(data, candidates, minDist, threads);
+
+    // In each round, pick each point independently with probability
+    // oversampling * k * minDist / (sum of minDist).
+    const double ell = opts.oversampling * numCentroids;
+    std::vector<char> picked(n);
+    for (int round = 0; (round < opts.rounds); round++) {
+        double psi = 0;
+        for (long i = 0; (i < n); i++) {
+            psi += minDist[i];
+        }
+        if (!(psi > 0)) {
+            break;  // Every point is a candidate already.
+        }
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (long i = 0; i < n; i++) {
+            picked[i] = hashUniform(opts.seed, round, i) <
+                (ell * minDist[i] / psi);
+        }
+        PointList added;
+        for (long i = 0; (i < n); i++) {
+            if (picked[i]) {
+                added.push_back(data.point(i));
+            }
+        }
+        if (!added.empty()) {
+            updateMinDist(data, added, minDist, threads);
+            candidates.insert(candidates.end(), added.begin(), added.end());
+        }
+    }
+
+    // Weight each candidate by the number of points closest to it.
+    const PointArray cand(candidates);
+    CentroidSums sums(candidates.size(), data.dims());
+    IntVec clsIdx(n);
+    const BasicCentroidTable<Real> table(candidates);
+    lloydStep(data, table, clsIdx, sums,
+              LloydOptions{0, opts.threads, true});
+    std::vector<double> weights(cand.size());
+    for (size_t c = 0; (c < cand.size()); c++) {
+        weights[c] = sums.count(c);
+    }
+
+    // Reduce the weighted candidates to k centroids with k-means++
+    // followed by a few weighted Lloyd iterations.
+    PointList centroids = plusPlus(cand, weights, numCentroids, rng, 1);
+    const int k = centroids.size(), dims = data.dims();
+    CentroidSums candSums;
+    for (int iter = 0; (iter < 10); iter++) {
+        const CentroidTable candTable(centroids);
+        candSums.reset(k, dims);
+        for (size_t c = 0; (c < cand.size()); c++) {
+            candSums.addWeighted(candTable.nearest(cand[c]), cand[c],
+                                 weights[c]);
+        }
+        for (int c = 0; (c < k); c++) {
+            candSums.computeWeightedCentroid(c, centroids[c]);
+        }
+    }
+    return centroids;
+}
+
+template<typename Real>
+PointList initCentroids(const BasicPointArray<Real>& data,
+                        const int numCentroids, const SeedOptions& opts) {
+    switch (opts.method) {
+    case Seeding::PlusPlus: return kmeansPlusPlus(data, numCentroids, opts);
+    case Seeding::Parallel: return kmeansParallel(data, numCentroids, opts);
+    default: break;
+    }
+    // Uniformly random subset of points.  sampleIndexes() picks the
+    // same points as getInitCentroid() without copying them into a
+    // PointList or building a list of all the indexes, so a mapped
+    // file larger than memory needs no memory per point.
+    const std::vector<size_t> picked = sampleIndexes(data.size(),
+                                                     numCentroids,
+                                                     opts.seed);
+    // Like kmeans++, this stops at data.size() centroids.
+    PointList centroids(picked.size());
+    for (size_t c = 0; (c < picked.size()); c++) {
+        centroids[c] = data.point(picked[c]);
+    }
+    return centroids;
+}
+
+// The seeding methods for the supported precisions.
+template PointList kmeansPlusPlus(const PointArray&, const int,
+                                  const SeedOptions&);
+template PointList kmeansPlusPlus(const PointArrayF&, const int,
+                                  const SeedOptions&);
+template PointList kmeansParallel(const PointArray&, const int,
+                                  const SeedOptions&);
+template PointList kmeansParallel(const PointArrayF&, const int,
+                                  const SeedOptions&);
+template PointList initCentroids(const PointArray&, const int,
+                                 const SeedOptions&);
+template PointList initCentroids(const PointArrayF&, const int,
+                                 const SeedOptions&);
+
+#endif
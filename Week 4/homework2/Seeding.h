@@ -0,0 +1,132 @@
+#ifndef SEEDING_H
+#define SEEDING_H
+
+/**
+ * Methods to pick the initial centroids for k-means.  Good initial
+ * centroids reduce the number of Lloyd iterations and usually give
+ * better clusters than a uniformly random subset of points.
+ *
+ * Copyright (C) 2021 John Doll
+ */
+
+#include <random>
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+
+/**
+ * The methods that can be used to pick the initial centroids.
+ *
+ *   - Random: a uniformly random subset of points (getInitCentroid).
+ *
+ *   - PlusPlus: k-means++ (Arthur and Vassilvitskii, 2007).  Each
+ *     new centroid is a point drawn with probability proportional
+ *     to its squared distance to the closest centroid picked so far
+ *     (D^2 sampling).
+ *
+ *   - Parallel: k-means|| (Bahmani et al., 2012).  Instead of k
+ *     sequential passes, a few rounds each pick about
+ *     oversampling * k points in parallel.  The candidates are
+ *     weighted by the number of points closest to them and reduced
+ *     to k centroids with a weighted k-means++ and Lloyd.
+ */
+enum class Seeding { Random, PlusPlus, Parallel };
+
+/**
+ * The options that control how the initial centroids are picked.
+ */
+struct SeedOptions {
+    /// The method used to pick the centroids.
+    Seeding method = Seeding::Random;
+
+    /// The seed for the random number generator.  The same seed
+    /// gives the same centroids, independent of the thread count.
+    unsigned seed = std::default_random_engine::default_seed;
+
+    /// The number of threads to be used. Zero uses the OpenMP default.
+    int threads = 0;
+
+    /// The number of oversampling rounds for k-means||.
+    int rounds = 5;
+
+    /// The expected number of points picked in each k-means|| round,
+    /// as a multiple of the number of centroids.
+    double oversampling = 2;
+};
+
+/**
+ * Picks k centroids using k-means++ seeding.
+ *
+ * \param[in] data The points being clustered.
+ *
+ * \param[in] numCentroids The number of centroids to be picked.
+ *
+ * \param[in] opts The seed and number of threads to be used.
+ *
+ * \return The initial centroids.
+ */
+template<typename Real>
+PointList kmeansPlusPlus(const BasicPointArray<Real>& data,
+                         const int numCentroids,
+                         const SeedOptions& opts = {});
+
+/**
+ * Picks k centroids from weighted points using k-means++ seeding.
+ * Each new centroid is drawn with probability proportional to the
+ * weight of a point times its squared distance to the closest
+ * centroid picked so far.  This is used to seed the clustering of a
+ * coreset (see Coreset.h).
+ *
+ * \param[in] data The weighted points.
+ *
+ * \param[in] weights The weight of each point.
+ *
+ * \param[in] numCentroids The number of centroids to be picked.
+ *
+ * \param[in] opts The seed and number of threads to be used.
+ *
+ * \return The initial centroids.
+ */
+PointList weightedKmeansPlusPlus(const PointArray& data,
+                                 const std::vector<double>& weights,
+                                 const int numCentroids,
+                                 const SeedOptions& opts = {});
+
+/**
+ * Picks k centroids using k-means|| seeding.
+ *
+ * \param[in] data The points being clustered.
+ *
+ * \param[in] numCentroids The number of centroids to be picked.
+ *
+ * \param[in] opts The seed, rounds, oversampling factor, and number
+ * of threads to be used.
+ *
+ * \return The initial centroids.  Like kmeansPlusPlus(), none are
+ * returned if data is empty.
+ */
+template<typename Real>
+PointList kmeansParallel(const BasicPointArray<Real>& data,
+                         const int numCentroids,
+                         const SeedOptions& opts = {});
+
+/**
+ * Picks the initial centroids using the method in opts.  Like the
+ * other methods in this file, it is defined for both PointArray and
+ * PointArrayF points.
+ *
+ * \param[in] data The points being clustered.
+ *
+ * \param[in] numCentroids The number of centroids to be picked.
+ *
+ * \param[in] opts The method and its options.
+ *
+ * \return The initial centroids.  There are fewer than numCentroids
+ * (none if data is empty) when there are fewer points than that.
+ */
+template<typename Real>
+PointList initCentroids(const BasicPointArray<Real>& data,
+                        const int numCentroids,
+                        const SeedOptions& opts = {});
+
+#endif
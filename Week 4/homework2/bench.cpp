@@ -0,0 +1,441 @@
+/**
+ * Copyright (C) 2021 John Doll
+ *
+ * A benchmark for the k-means code.  It clusters synthetic datasets of
+ * Gaussian blobs (or a given file) and reports, for each run, the time
+ * taken to load (or generate) the points, to seed the centroids, and
+ * to assign the points and update the centroids in each iteration,
+ * along with the number of iterations, distance computations, and the
+ * final getTotDist().  The Lloyd iterations are the same as those in
+ * setClosestCentroid(), so the results match main.cpp.
+ *
+ * The datasets and the initial centroids only depend on the seeds, so
+ * two builds of the clustering code can be compared run by run: a
+ * different iteration count or tot_dist (printed with 17 digits)
+ * signals a change in the results, not just in the speed.  Use
+ * --deterministic to also make the results independent of --threads.
+ *
+ * The optional command-line arguments are:
+ *   --n N,...           The number of points (default 100000).
+ *   --d D,...           The number of dimensions (default 2).
+ *   --k K,...           The number of centroids (default 16).
+ *   --blobs B           The number of blobs (default: k).
+ *   --spread S          The standard deviation of each blob (default 1).
+ *   --box W             The blob centers are uniform in [-W, W]^d
+ *                       (default 10).
+ *   --seed S            The seed for the data and the centroids.
+ *   --init I            random, kmeans++, or kmeans|| (see Seeding.h).
+ *   --threads T         The number of threads.
+ *   --deterministic     Reproducible sums for any number of threads.
+ *   --maxiter I         The maximum number of iterations (default 100).
+ *   --float             Cluster single-precision points.
+ *   --repeat R          Run each configuration R times (default 1).
+ *   --input F --cols C  Cluster the first C columns of a TSV or binary
+ *                       point file instead of generated points.
+ *   --write F           Write the (first) generated dataset to a TSV
+ *                       file, to be used with main.cpp.
+ *   --format csv|json   The output format (default csv).
+ * Lists (N,... etc.) run every combination of the values.
+ *
+ * Compile and run with:
+ *   $ g++ -std=c++17 -O3 -march=native -fopenmp -o bench bench.cpp \
+ *         KmeansHelper.cpp CentroidTable.cpp Lloyd.cpp Elkan.cpp \
+ *         KdTree.cpp PointStream.cpp Seeding.cpp MappedPoints.cpp \
+ *         PointLoader.cpp
+ *   $ ./bench --n 100000,1000000 --d 2,8 --k 16,64 --format json
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+#include "Seeding.h"
+#include "PointLoader.h"
+
+// It is ok to use the following namespace delarations in C++ source
+// files only. They must never be used in header files.
+using namespace std;
+
+/** The clock used to time each phase. */
+using Clock = chrono::steady_clock;
+
+/**
+ * The command-line arguments of the benchmark.
+ */
+struct BenchOptions {
+    /// The number of points, dimensions, and centroids to be tried.
+    vector<size_t> ns = {100000};
+    vector<int> dims  = {2};
+    vector<int> ks    = {16};
+    /// The number of blobs (0 uses k), their spread, and the box
+    /// from which their centers are picked.
+    int blobs = 0;
+    double spread = 1, box = 10;
+    /// The seed for the data; the seeding uses seeding.seed.
+    unsigned seed = 1;
+    /// The seeding and Lloyd options.
+    SeedOptions seeding;
+    LloydOptions lloyd;
+    /// Cluster single-precision points.
+    bool useFloat = false;
+    /// The number of runs of each configuration.
+    int repeats = 1;
+    /// The file to be clustered instead of generated points.
+    string input;
+    int inputCols = 0;
+    /// The file to which the generated points are written.
+    string writePath;
+    /// Print JSON instead of CSV.
+    bool json = false;
+};
+
+/**
+ * The measurements of one run.
+ */
+struct BenchRun {
+    /// The configuration.
+    size_t n = 0;
+    int d = 0, k = 0, repeat = 0;
+    /// The time to load or generate the points and to seed them.
+    double loadMs = 0, seedMs = 0;
+    /// The assign and update times of each iteration.
+    vector<double> assignMs, updateMs;
+    /// The number of point-centroid distances computed.
+    long distances = 0;
+    /// The total distance of the points from their centroids.
+    double totDist = 0;
+};
+
+/**
+ * Returns the milliseconds elapsed since a given time.
+ */
+static double msSince(const Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+/**
+ * Splits a comma-separated list of numbers.
+ */
+template<typename T>
+static vector<T> parseList(const string& list) {
+    vector<T> values;
+    istringstream is(list);
+    string value;
+    while (getline(is, value, ',')) {
+        values.push_back(T(stod(value)));
+    }
+    return values;
+}
+
+/**
+ * Generates points from Gaussian blobs.  The blob centers are drawn
+ * uniformly from [-box, box]^d, and each point picks a blob uniformly
+ * and adds normally distributed noise with a standard deviation of
+ * spread to each coordinate.  The points only depend on the
+ * arguments, so every run (and every build) sees the same data.
+ *
+ * \param[in] n The number of points.
+ *
+ * \param[in] d The number of dimensions.
+ *
+ * \param[in] blobs The number of blobs.
+ *
+ * \param[in] opts The spread, box, and seed to be used.
+ *
+ * \return The generated points.
+ */
+PointArray generateBlobs(const size_t n, const int d, const int blobs,
+                         const BenchOptions& opts) {
+    mt19937_64 rng(opts.seed);
+    uniform_real_distribution<double> center(-opts.box, opts.box);
+    vector<double> centers(blobs * d);
+    for (auto& c : centers) {
+        c = center(rng);
+    }
+    uniform_int_distribution<int> pick(0, blobs - 1);
+    normal_distribution<double> noise(0, opts.spread);
+    PointArray points(n, d);
+    for (size_t i = 0; (i < n); i++) {
+        const double* c = &centers[pick(rng) * d];
+        for (int j = 0; (j < d); j++) {
+            points[i][j] = c[j] + noise(rng);
+        }
+    }
+    return points;
+}
+
+/**
+ * Writes points to a TSV file that main.cpp can read.
+ */
+void writeTsv(const PointArray& points, const string& path) {
+    ofstream os(path);
+    if (!os.good()) {
+        throw runtime_error("Error creating file " + path);
+    }
+    os << setprecision(17);
+    for (size_t i = 0; (i < points.size()); i++) {
+        for (int j = 0; (j < points.dims()); j++) {
+            os << ((j > 0) ? "\t" : "") << points[i][j];
+        }
+        os << '\n';
+    }
+}
+
+/**
+ * Seeds and clusters the points, timing each phase.  The iterations
+ * are those of setClosestCentroid() without the accelerated
+ * algorithms: the first iteration uses lloydStep() and the rest use
+ * lloydUpdate().  The assign time includes accumulating the sums; the
+ * update time is computing the new centroids and checking for
+ * convergence.
+ *
+ * \param[in] points The points to be clustered.
+ *
+ * \param[in] k The number of centroids.
+ *
+ * \param[in] opts The seeding and Lloyd options.
+ *
+ * \param[in,out] run The measurements are stored here.
+ */
+template<typename Real>
+void runKmeans(const BasicPointArray<Real>& points, const int k,
+               const BenchOptions& opts, BenchRun& run) {
+    auto start = Clock::now();
+    PointList centroids = initCentroids(points, k, opts.seeding);
+    run.seedMs = msSince(start);
+
+    IntVec clsIdx(points.size());
+    BasicCentroidTable<Real> table;
+    CentroidSums sums;
+    for (int iter = 0; (iter < opts.lloyd.maxIterations); iter++) {
+        start = Clock::now();
+        table.load(centroids);
+        long changed = points.size();
+        if (iter == 0) {
+            run.distances += lloydStep(points, table, clsIdx, sums,
+                                       opts.lloyd);
+        } else {
+            run.distances += lloydUpdate(points, table, clsIdx, sums,
+                                         opts.lloyd, changed);
+        }
+        run.assignMs.push_back(msSince(start));
+        start = Clock::now();
+        const PointList prevCentroids = centroids;
+        for (size_t c = 0; (c < centroids.size()); c++) {
+            sums.computeNewCentroid(c, centroids[c]);
+        }
+        const bool done = converged(prevCentroids, centroids, changed,
+                                    opts.lloyd);
+        run.updateMs.push_back(msSince(start));
+        if (done) {
+            break;
+        }
+    }
+    run.totDist = getTotDist(points, centroids, clsIdx);
+}
+
+/**
+ * Processes the command-line arguments.  Unknown options result in
+ * an exception.
+ */
+BenchOptions parseOptions(int argc, char *argv[]) {
+    BenchOptions opts;
+    opts.seeding.seed = opts.seed;
+    for (int i = 1; (i < argc); i++) {
+        const string arg = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if (arg == "--n" && hasValue) {
+            opts.ns = parseList<size_t>(argv[++i]);
+        } else if (arg == "--d" && hasValue) {
+            opts.dims = parseList<int>(argv[++i]);
+        } else if (arg == "--k" && hasValue) {
+            opts.ks = parseList<int>(argv[++i]);
+        } else if (arg == "--blobs" && hasValue) {
+            opts.blobs = stoi(argv[++i]);
+        } else if (arg == "--spread" && hasValue) {
+            opts.spread = stod(argv[++i]);
+        } else if (arg == "--box" && hasValue) {
+            opts.box = stod(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            opts.seed = opts.seeding.seed = stoul(argv[++i]);
+        } else if (arg == "--init" && hasValue) {
+            const string init = argv[++i];
+            if (init == "random") {
+                opts.seeding.method = Seeding::Random;
+            } else if (init == "kmeans++") {
+                opts.seeding.method = Seeding::PlusPlus;
+            } else if (init == "kmeans||") {
+                opts.seeding.method = Seeding::Parallel;
+            } else {
+                throw invalid_argument("Invalid --init: " + init);
+            }
+        } else if (arg == "--threads" && hasValue) {
+            opts.lloyd.threads = opts.seeding.threads = stoi(argv[++i]);
+        } else if (arg == "--deterministic") {
+            opts.lloyd.deterministic = true;
+        } else if (arg == "--maxiter" && hasValue) {
+            opts.lloyd.maxIterations = stoi(argv[++i]);
+        } else if (arg == "--float") {
+            opts.useFloat = true;
+        } else if (arg == "--repeat" && hasValue) {
+            opts.repeats = stoi(argv[++i]);
+        } else if (arg == "--input" && hasValue) {
+            opts.input = argv[++i];
+        } else if (arg == "--cols" && hasValue) {
+            opts.inputCols = stoi(argv[++i]);
+        } else if (arg == "--write" && hasValue) {
+            opts.writePath = argv[++i];
+        } else if (arg == "--format" && hasValue) {
+            const string format = argv[++i];
+            if ((format != "csv") && (format != "json")) {
+                throw invalid_argument("Invalid --format: " + format);
+            }
+            opts.json = (format == "json");
+        } else {
+            throw invalid_argument("Invalid option: " + arg);
+        }
+    }
+    if (!opts.input.empty() && (opts.inputCols <= 0)) {
+        throw invalid_argument("--input needs --cols");
+    }
+    return opts;
+}
+
+/**
+ * Prints the CSV header or the start of the JSON array.
+ */
+void writeHeader(const BenchOptions& opts, ostream& os) {
+    if (opts.json) {
+        os << "[";
+    } else {
+        os << "n,d,k,blobs,spread,seed,init,precision,threads,repeat,"
+           << "load_ms,seed_ms,iterations,assign_ms,update_ms,total_ms,"
+           << "distances,tot_dist\n";
+    }
+}
+
+/**
+ * Prints one run as a CSV row or a JSON object.  The JSON object also
+ * has the assign and update times of each iteration.
+ */
+void writeRun(const BenchRun& run, const BenchOptions& opts, const bool first,
+              ostream& os) {
+    const char* inits[] = {"random", "kmeans++", "kmeans||"};
+    double assign = 0, update = 0;
+    for (size_t i = 0; (i < run.assignMs.size()); i++) {
+        assign += run.assignMs[i];
+        update += run.updateMs[i];
+    }
+    const double total = run.loadMs + run.seedMs + assign + update;
+    const int blobs = opts.input.empty() ? ((opts.blobs > 0) ? opts.blobs :
+                                            run.k) : 0;
+    const string precision = opts.useFloat ? "float" : "double";
+    const int threads = threadCount(opts.lloyd);
+    const string init = inits[int(opts.seeding.method)];
+    os << fixed << setprecision(3);
+    if (!opts.json) {
+        os << run.n << ',' << run.d << ',' << run.k << ',' << blobs << ','
+           << opts.spread << ',' << opts.seed << ',' << init << ','
+           << precision << ',' << threads << ',' << run.repeat << ','
+           << run.loadMs << ',' << run.seedMs << ','
+           << run.assignMs.size() << ',' << assign << ',' << update << ','
+           << total << ',' << run.distances << ','
+           << defaultfloat << setprecision(17) << run.totDist << '\n';
+        return;
+    }
+    auto list = [&](const vector<double>& values) {
+        os << '[';
+        for (size_t i = 0; (i < values.size()); i++) {
+            os << ((i > 0) ? ", " : "") << values[i];
+        }
+        os << ']';
+    };
+    os << (first ? "\n" : ",\n") << "  {\"n\": " << run.n << ", \"d\": "
+       << run.d << ", \"k\": " << run.k << ", \"blobs\": " << blobs
+       << ", \"spread\": " << opts.spread << ", \"seed\": " << opts.seed
+       << ", \"init\": \"" << init << "\", \"precision\": \"" << precision
+       << "\", \"threads\": " << threads << ", \"repeat\": " << run.repeat
+       << ",\n   \"load_ms\": " << run.loadMs << ", \"seed_ms\": "
+       << run.seedMs << ", \"iterations\": " << run.assignMs.size()
+       << ", \"assign_ms\": " << assign << ", \"update_ms\": " << update
+       << ", \"total_ms\": " << total << ",\n   \"distances\": "
+       << run.distances << ", \"tot_dist\": " << defaultfloat
+       << setprecision(17) << run.totDist << fixed << setprecision(3)
+       << ",\n   \"assign_iter_ms\": ";
+    list(run.assignMs);
+    os << ",\n   \"update_iter_ms\": ";
+    list(run.updateMs);
+    os << "}";
+}
+
+int main(int argc, char *argv[]) {
+    const BenchOptions opts = parseOptions(argc, argv);
+    writeHeader(opts, cout);
+    bool first = true, written = opts.writePath.empty();
+    // Each dataset is loaded (or generated) once for all values of k.
+    const size_t datasets = opts.input.empty() ?
+        opts.ns.size() * opts.dims.size() : 1;
+    for (size_t ds = 0; (ds < datasets); ds++) {
+        const auto start = Clock::now();
+        PointArray data;
+        if (!opts.input.empty()) {
+            data = loadPoints(opts.input, opts.inputCols, opts.lloyd.threads);
+        } else {
+            const int d = opts.dims[ds % opts.dims.size()];
+            const int blobs = (opts.blobs > 0) ? opts.blobs : opts.ks.front();
+            data = generateBlobs(opts.ns[ds / opts.dims.size()], d, blobs,
+                                 opts);
+        }
+        const double loadMs = msSince(start);
+        if (!written) {
+            writeTsv(data, opts.writePath);
+            written = true;
+        }
+        for (const int k : opts.ks) {
+            // With the default blobs, each k gets its own dataset, and
+            // its runs report the time taken to generate that one.
+            PointArray blobData;
+            double pointsMs = loadMs;
+            if (opts.input.empty() && (opts.blobs == 0) &&
+                (k != opts.ks.front())) {
+                const auto genStart = Clock::now();
+                blobData = generateBlobs(data.size(), data.dims(), k, opts);
+                pointsMs = msSince(genStart);
+            }
+            const PointArray& points = (blobData.size() > 0) ? blobData :
+                data;
+            for (int rep = 0; (rep < opts.repeats); rep++) {
+                BenchRun run;
+                run.n = points.size();
+                run.d = points.dims();
+                run.k = k;
+                run.repeat = rep;
+                run.loadMs = pointsMs;
+                if (opts.useFloat) {
+                    PointArrayF pointsF(points.size(), points.dims());
+                    copy_n(points[0], points.size() * points.dims(),
+                           pointsF[0]);
+                    runKmeans(pointsF, k, opts, run);
+                } else {
+                    runKmeans(points, k, opts, run);
+                }
+                writeRun(run, opts, first, cout);
+                first = false;
+            }
+        }
+    }
+    if (opts.json) {
+        cout << "\n]\n";
+    }
+    return 0;
+}
+
+// End of source code
@@ -2,231 +2,377 @@
 
 #include <iostream>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <iomanip>
 #include <utility>
 #include <vector>
 #include <algorithm>
 #include <numeric>
 #include <unordered_map>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
 #include "Kmeans.h"
+#include "PointArray.h"
+#include "Lloyd.h"
+#include "MiniBatch.h"
+#include "Seeding.h"
+#include "MultiRun.h"
+#include "MappedPoints.h"
+#include "Coreset.h"
+#include "PointLoader.h"
+#include "OnlineKmeans.h"
 
 // It is ok to use the following namespace delarations in C++ source
 // files only. They must never be used in header files.
 using namespace std;
 using namespace std::string_literals;
+using namespace std::chrono_literals;
 
 /**
- * This method splits up the line it receives and creates a point from
- * the corresponding values.
- * 
- * \param[in] ifs The stringstream line that will be split into separate values.
- * 
- * \param[in] numCols The number of columns that will be read in per line to
- * create the point.
- * 
- * \return The point created from the line sent to this method.
+ * The optional command-line arguments that may follow the three
+ * required arguments.
  */
-Point split(istringstream& ifs, int numCols) {
-    // create string to get each value in the string and the point to be
-    // returned
-    string value;
-    Point p(numCols);
-    for (int i = 0; i < numCols; i++) {
-        ifs >> quoted(value);
-        // add each dimension to the point
-        p[i] = stod(value);
-    }
-    return p;
-}
+struct Options {
+    /// The options for the Lloyd iterations (--threads N,
+    /// --deterministic, --tolerance T, --changed N, and
+    /// --accel elkan|hamerly|kdtree).
+    LloydOptions lloyd;
 
-/**
- * Reads in the file specified in the command line arguments and returns a 
- * PointList from the file.
- * 
- * \param[in] is The file stream to be read.
- * 
- * \param[in] numCols The number of columns that we will be reading per line
- * when creating points.
- * 
- * \return The PointList of all points in the file.
- */
-PointList parseFile(ifstream& is, int numCols) {
-    // create a PointList and line to read each line and add corresponding
-    // points to
-    PointList pl;
-    string line;
-    while (getline(is, line)) {
-        // interprets line if it isn't empty and doesn't begin with #
-        if (line != "" && line.substr(0, 1) != "#") {
-            istringstream iss(line);
-            Point p = split(iss, numCols);
-            pl.push_back(p);
-        }
-    }
-    return pl;
-}
+    /// Print the number of iterations, distance computations, and
+    /// the time taken to std::cerr (--stats).
+    bool stats = false;
 
-/**
- * Finds the centroid closest to the given point.
- * 
- * \param[in] p Point that we are trying to find the closest centroid for.
- * 
- * \param[in] centroids All centroids
- * 
- * \return the index in centroids of the closest centroid to point p.
- */
-int getClosestCentroid(Point p, PointList centroids) {
-    // set index of closest point to 0 and the intial distance to the distance
-    // between the point and the first centroid
-    int closest = 0;
-    double smallest = distance(p, centroids[0]);
-    for (size_t i = 0; i < centroids.size(); i++) {
-        // if the distance between the specified centroid and the given point
-        // is less than the current smallest distance, then we have a new 
-        // closest centroid, so set smallest to that distance and set closest
-        // equal to that location
-        if (distance(p, centroids[i]) < smallest) {
-            smallest = distance(p, centroids[i]);
-            closest = i;
-        }
-    }
-    return closest;
-}
+    /// Use mini-batch k-means, streaming the points from the file,
+    /// if the batch size is not zero (--minibatch B and --batches T).
+    /// parseOptions() sets the batch size to zero unless --minibatch
+    /// is given.
+    MiniBatchOptions miniBatch = {};
+
+    /// How the initial centroids are picked (--init and --seed).
+    SeedOptions seeding;
+
+    /// The number of restarts for each k (--restarts R).
+    int restarts = 1;
+
+    /// If larger than the number of centroids, every k up to this
+    /// value is tried (--kmax K).
+    int maxK = 0;
+
+    /// Store the points and compute distances in single precision
+    /// (--float).  Only plain Lloyd iterations are supported.
+    bool useFloat = false;
+
+    /// Memory-map a binary point file and run the Lloyd iterations
+    /// over it without loading it (--mmap).
+    bool mapFile = false;
+
+    /// If not zero, the number of points drawn for a coreset which is
+    /// clustered instead of all the points (--coreset M).
+    size_t coresetSize = 0;
+
+    /// Run online k-means over the points as they are read, writing
+    /// snapshots of the centroids (--online, --decay D, --every N,
+    /// and --interval T).  The file may be "-" for std::cin.
+    bool online = false;
+    OnlineOptions onlineOpts;
+};
 
 /**
- * Gets the points closest to a specific centroid.
- * 
- * \param[in] pl PointList of all points.
- * 
- * \param[in] centIdx Index of which centroid each point is closest to.
- * 
- * \param[in] loc The specific centroid index we are trying to find which 
- * points are closest to it. 
- * 
- * \return A PointList of all points that are closest to the specified centroid.
+ * Processes the optional command-line arguments.
+ *
+ * \param[in] argc The number of command-line arguments.
+ *
+ * \param[in] argv The command-line arguments.  The optional
+ * arguments start at argv[4].
+ *
+ * \return The options parsed from the command-line. Unknown options
+ * result in an exception.
  */
-PointList specificCentroids(PointList pl, IntVec centIdx, int loc) {
-    // create PointList of potential matching points
-    PointList matches;
-    for (size_t i = 0; i < centIdx.size(); i++) {
-        // if the centroid at i equals the location, then this point belongs to
-        // the centroid we are evaluating
-        if (centIdx[i] == loc) {
-            matches.push_back(pl[i]);
+Options parseOptions(int argc, char *argv[]) {
+    Options opts;
+    // Mini-batch k-means is off unless --minibatch is given.
+    opts.miniBatch.batchSize = 0;
+    for (int i = 4; (i < argc); i++) {
+        const string arg = argv[i];
+        if (arg == "--threads" && (i + 1 < argc)) {
+            opts.lloyd.threads = stoi(argv[++i]);
+        } else if (arg == "--deterministic") {
+            opts.lloyd.deterministic = true;
+        } else if (arg == "--tolerance" && (i + 1 < argc)) {
+            opts.lloyd.tolerance = stod(argv[++i]);
+        } else if (arg == "--changed" && (i + 1 < argc)) {
+            opts.lloyd.changedTolerance = stol(argv[++i]);
+        } else if (arg == "--accel" && (i + 1 < argc)) {
+            const string accel = argv[++i];
+            if (accel == "none") {
+                opts.lloyd.accel = Accel::None;
+            } else if (accel == "elkan") {
+                opts.lloyd.accel = Accel::Elkan;
+            } else if (accel == "hamerly") {
+                opts.lloyd.accel = Accel::Hamerly;
+            } else if (accel == "kdtree") {
+                opts.lloyd.accel = Accel::KdTree;
+            } else {
+                throw invalid_argument("Invalid --accel: " + accel);
+            }
+        } else if (arg == "--minibatch" && (i + 1 < argc)) {
+            opts.miniBatch.batchSize = stoul(argv[++i]);
+        } else if (arg == "--batches" && (i + 1 < argc)) {
+            opts.miniBatch.batches = stoi(argv[++i]);
+        } else if (arg == "--init" && (i + 1 < argc)) {
+            const string init = argv[++i];
+            if (init == "random") {
+                opts.seeding.method = Seeding::Random;
+            } else if (init == "kmeans++") {
+                opts.seeding.method = Seeding::PlusPlus;
+            } else if (init == "kmeans||") {
+                opts.seeding.method = Seeding::Parallel;
+            } else {
+                throw invalid_argument("Invalid --init: " + init);
+            }
+        } else if (arg == "--seed" && (i + 1 < argc)) {
+            opts.seeding.seed = stoul(argv[++i]);
+        } else if (arg == "--restarts" && (i + 1 < argc)) {
+            opts.restarts = stoi(argv[++i]);
+        } else if (arg == "--kmax" && (i + 1 < argc)) {
+            opts.maxK = stoi(argv[++i]);
+        } else if (arg == "--float") {
+            opts.useFloat = true;
+        } else if (arg == "--mmap") {
+            opts.mapFile = true;
+        } else if (arg == "--coreset" && (i + 1 < argc)) {
+            opts.coresetSize = stoul(argv[++i]);
+        } else if (arg == "--online") {
+            opts.online = true;
+        } else if (arg == "--decay" && (i + 1 < argc)) {
+            opts.onlineOpts.decay = stod(argv[++i]);
+        } else if (arg == "--every" && (i + 1 < argc)) {
+            opts.onlineOpts.snapshotPoints = stol(argv[++i]);
+        } else if (arg == "--interval" && (i + 1 < argc)) {
+            opts.onlineOpts.snapshotSeconds = stod(argv[++i]);
+        } else if (arg == "--stats") {
+            opts.stats = true;
+        } else {
+            throw invalid_argument("Invalid option: " + arg);
         }
     }
-    return matches;
-}
-
-/**
- * This method creates a new centroid by centering it with the points it is a 
- * centroid for.
- * 
- * \param[in] matches The PointList of all points that are closest to this
- * centroid.
- * 
- * \return The new location of the centroid.
- */
-Point computeNewCentroid(PointList matches) {
-    // Get the number of matches and create a new point with the correct 
-    // dimensions as this will be our new centroid
-    int size = matches.size();
-    Point newCentroid(matches[0].size());
-    // add all the points into the new centroid
-    for (auto pt : matches) {
-        newCentroid += pt;
+    if (opts.useFloat && opts.lloyd.accel != Accel::None) {
+        throw invalid_argument("--accel cannot be used with --float");
     }
-    // divide each dimension of the centroid by the size in order to average
-    // the centroid out
-    for (size_t i = 0; i < newCentroid.size(); i++) {
-        newCentroid[i] /= size;
+    if (opts.useFloat && opts.mapFile) {
+        throw invalid_argument("--mmap files store doubles; omit --float");
     }
-    return newCentroid;
-}
-
-/**
- * Checks if the previous and current centroids are the same.
- * 
- * \param[in] prevCentroids The old PointList of centroids.
- * 
- * \param[in] centroids The new PointList of centroids.
- * 
- * \return true if they are the same and false otherwise
- */
-bool centroidsSame(PointList prevCentroids, PointList centroids) {
-    for (size_t i = 0; i < centroids.size(); i++) {
-        for (size_t j = 0; j < centroids[0].size(); j++) {
-            // if points are not equal, then return false as the PointLists are
-            // not the same
-            if (centroids[i][j] != prevCentroids[i][j]) {
-                return false;
-            }
-        } 
+    if ((opts.coresetSize > 0) && ((opts.restarts > 1) || (opts.maxK > 0) ||
+                                   (opts.lloyd.accel != Accel::None))) {
+        throw invalid_argument("--coreset cannot be used with --restarts, "
+                               "--kmax, or --accel");
     }
-    return true;
+    // The seeding and mini-batch modes use the same threads.
+    opts.seeding.threads = opts.lloyd.threads;
+    opts.miniBatch.seeding = opts.seeding;
+    return opts;
 }
 
 /**
- * Returns the index of the closest centroids to each point.
- * 
- * \param[in] pl The PointList of all points.
- * 
- * \param[in] centroids The PointList of all centroids.
- * 
- * \param[in] iterations The number of iterations to run.
- * 
- * \return The index of the centroid closest to each corresponding point.
+ * Clusters the points read from the file and writes the results.
+ * The points are clustered in the precision given by Real, while the
+ * centroids and the output are always in double.
+ *
+ * \param[in] data The points read from the file.
+ *
+ * \param[in] points The points to be clustered: data itself, or data
+ * converted to Real.
+ *
+ * \param[in] numCentroids The number of centroids (the smallest k
+ * with --kmax).  It must be at least 1.
+ *
+ * \param[in] opts The optional command-line arguments.
  */
-IntVec setClosestCentroid(PointList pl, PointList centroids, int iterations) {
-    // creation iteration counter and centroid index vector to be returned
-    int iteration = 0;
-    IntVec retCentIdx;
-    while (iteration < iterations) {
-        IntVec centIdx;
-        // find closest centroid for each point
-        for (size_t i = 0; i < pl.size(); i++) {
-            centIdx.push_back(getClosestCentroid(pl.at(i), centroids));
+template<typename Real>
+void cluster(const PointArray& data, const BasicPointArray<Real>& points,
+             const int numCentroids, const Options& opts) {
+    if (opts.restarts > 1 || opts.maxK > numCentroids) {
+        // Run the restarts for each k and write the best solution
+        // at the elbow of the curve.
+        MultiRunOptions multi;
+        multi.restarts = opts.restarts;
+        multi.minK     = numCentroids;
+        multi.maxK     = max(numCentroids, opts.maxK);
+        multi.lloyd    = opts.lloyd;
+        multi.seeding  = opts.seeding;
+        const auto startTime = chrono::high_resolution_clock::now();
+        const auto results = multiRun(points, multi);
+        const auto endTime = chrono::high_resolution_clock::now();
+        writeElbow(results, cerr);
+        const RunResult& best = results.at(elbowIndex(results));
+        if (opts.stats) {
+            cerr << "Runs: " << results.size() * multi.restarts
+                 << ", chosen k: " << best.k << ", elapsed time: "
+                 << ((endTime - startTime) / 1ms) << " milliseconds\n";
         }
-        // save current list of centroids in old list
-        PointList prevCentroids = centroids;
-        // rearrange centroids to be more in the center of their list of points
-        for (size_t i = 0; i < centroids.size(); i++) {
-            PointList matches = specificCentroids(pl, centIdx, i);
-            centroids[i] = computeNewCentroid(matches);
-        }
-        // check if the centroid lists are the same so that we don't do 
-        // unnecessary iterations
-        if (centroidsSame(prevCentroids, centroids)) {
-            break;
+        writeResults(data, best.centroids, best.clsIdx, cout);
+        return;
+    }
+    if (opts.coresetSize > 0) {
+        // Cluster a weighted sample of the points and then assign all
+        // the points to the resulting centroids.
+        CoresetOptions coresetOpts;
+        coresetOpts.size    = opts.coresetSize;
+        coresetOpts.seed    = opts.seeding.seed;
+        coresetOpts.threads = opts.lloyd.threads;
+        const auto startTime = chrono::high_resolution_clock::now();
+        const Coreset coreset = buildCoreset(points, numCentroids,
+                                             coresetOpts);
+        const auto buildTime = chrono::high_resolution_clock::now();
+        PointList centroids = weightedKmeansPlusPlus(coreset.points,
+                                                     coreset.weights,
+                                                     numCentroids,
+                                                     opts.seeding);
+        int iterations = 0;
+        weightedKmeans(coreset, centroids, opts.lloyd, &iterations);
+        IntVec centIdx(points.size());
+        CentroidSums sums;
+        lloydStep(points, BasicCentroidTable<Real>(centroids), centIdx, sums,
+                  opts.lloyd);
+        const auto endTime = chrono::high_resolution_clock::now();
+        if (opts.stats) {
+            cerr << "Coreset points: " << coreset.points.size()
+                 << ", build time: " << ((buildTime - startTime) / 1ms)
+                 << " milliseconds\nIterations: " << iterations
+                 << ", elapsed time: " << ((endTime - startTime) / 1ms)
+                 << " milliseconds\n";
         }
-        retCentIdx = centIdx;
-        iteration++;
+        writeResults(data, centroids, centIdx, cout);
+        return;
     }
-    return retCentIdx;
+    // get centroids
+    const auto startTime = chrono::high_resolution_clock::now();
+    PointList centroids = initCentroids(points, numCentroids, opts.seeding);
+    const auto seedTime = chrono::high_resolution_clock::now();
+    // get which centroid the points are closest to
+    int iterations = 0;
+    long distCount = 0;
+    const IntVec centIdx = setClosestCentroid(points, centroids, opts.lloyd,
+                                              &iterations, &distCount);
+    const auto endTime = chrono::high_resolution_clock::now();
+    if (opts.stats) {
+        cerr << "Seeding time: " << ((seedTime - startTime) / 1ms)
+             << " milliseconds\n";
+        // Plain Lloyd computes the distance to every centroid.
+        const long total = long(points.size()) * centroids.size() * iterations;
+        cerr << "Iterations: " << iterations << ", distances: "
+             << distCount << ", skipped: " << (total - distCount)
+             << ", elapsed time: " << ((endTime - startTime) / 1ms)
+             << " milliseconds\n";
+    }
+    // output results
+    writeResults(data, centroids, centIdx, cout);
 }
 
 // main method
 int main(int argc, char *argv[]) {
-    ifstream is(argv[1]);
-    if (is.good()) {
-        // create PointList of all points
-        PointList pl = parseFile(is, stoi(argv[2]));
-        IntVec centIdx;
-        PointList centroids;
-        // if argv[3] is greater than 0, then we have centroids to work with
-        if (stoi(argv[3]) > 0) {
-            // get centroids
-            centroids = getInitCentroid(pl, stoi(argv[3]));
-            int maxIterations = 100;
-            // get which centroid the points are closest to
-            centIdx = setClosestCentroid(pl, centroids, maxIterations);
+    if (argc < 4) {
+        cerr << "Usage: <TSVFile> <NumCols> <NumCentroids> [--threads N] "
+             << "[--deterministic] [--tolerance T] [--changed N] "
+             << "[--accel none|elkan|hamerly|kdtree] "
+             << "[--minibatch B [--batches T]] "
+             << "[--init random|kmeans++|kmeans||] [--seed S] "
+             << "[--restarts R] [--kmax K] [--float] [--mmap] "
+             << "[--coreset M] [--online [--decay D] [--every N] "
+             << "[--interval T]] [--stats]\n";
+        return 1;
+    }
+    // Report bad options and files, as with the usage above, rather
+    // than aborting.
+    try {
+        const Options opts = parseOptions(argc, argv);
+        if (opts.online && stoi(argv[3]) > 0) {
+            // Cluster the points as they arrive; only the centroids are
+            // kept, so the input may be an endless pipe.
+            const string path = argv[1];
+            ifstream file;
+            if (path != "-") {
+                file.open(path);
+                if (!file.good()) {
+                    throw runtime_error("Error opening file " + path);
+                }
+            } else {
+                ios::sync_with_stdio(false);
+            }
+            istream& is = (path == "-") ? cin : file;
+            const auto startTime = chrono::high_resolution_clock::now();
+            onlineKmeans(is, stoi(argv[2]), stoi(argv[3]), opts.onlineOpts,
+                         cout, (path == "-") ? "stdin" : path);
+            const auto endTime = chrono::high_resolution_clock::now();
+            if (opts.stats) {
+                cerr << "Elapsed time: " << ((endTime - startTime) / 1ms)
+                     << " milliseconds\n";
+            }
+            return 0;
+        }
+        if (opts.miniBatch.batchSize > 0 && stoi(argv[3]) > 0) {
+            // Stream the points rather than loading the whole file.
+            PointStream stream(argv[1], stoi(argv[2]));
+            const auto startTime = chrono::high_resolution_clock::now();
+            const PointList centroids = miniBatchKmeans(stream, stoi(argv[3]),
+                                                        opts.miniBatch);
+            const auto endTime = chrono::high_resolution_clock::now();
+            if (opts.stats) {
+                cerr << "Batches: " << opts.miniBatch.batches
+                     << ", elapsed time: " << ((endTime - startTime) / 1ms)
+                     << " milliseconds\n";
+            }
+            writeResults(stream, centroids, cout);
+            return 0;
+        }
+        if (opts.mapFile && stoi(argv[3]) > 0) {
+            // Cluster the points in-place in the mapped file.
+            const MappedPointFile file(argv[1]);
+            if (file.points().dims() != stoi(argv[2])) {
+                throw invalid_argument("--mmap file has a different NumCols");
+            }
+            const auto startTime = chrono::high_resolution_clock::now();
+            PointList centroids = initCentroids(file.points(), stoi(argv[3]),
+                                                opts.seeding);
+            long distCount = 0;
+            const int iterations = mappedKmeans(file, centroids, opts.lloyd,
+                                                &distCount);
+            const auto endTime = chrono::high_resolution_clock::now();
+            if (opts.stats) {
+                cerr << "Iterations: " << iterations << ", distances: "
+                     << distCount << ", elapsed time: "
+                     << ((endTime - startTime) / 1ms) << " milliseconds\n";
+            }
+            // Assign and print the points one chunk at a time.
+            PointStream stream(argv[1], stoi(argv[2]));
+            writeResults(stream, centroids, cout);
+            return 0;
+        }
+        // load all the points
+        const auto loadStart = chrono::high_resolution_clock::now();
+        const PointArray data = loadPoints(argv[1], stoi(argv[2]),
+                                           opts.lloyd.threads);
+        if (opts.stats) {
+            cerr << "Loaded " << data.size() << " points in "
+                 << ((chrono::high_resolution_clock::now() - loadStart) / 1ms)
+                 << " milliseconds\n";
+        }
+        const int numCentroids = stoi(argv[3]);
+        if (numCentroids <= 0) {
+            // just print the data that was read
+            writeResults(data, {}, {}, cout);
+        } else if (opts.useFloat) {
+            // Only the points being clustered are converted to float.
+            PointArrayF points(data.size(), data.dims());
+            copy_n(data[0], data.size() * data.dims(), points[0]);
+            cluster(data, points, numCentroids, opts);
+        } else {
+            cluster(data, data, numCentroids, opts);
         }
-        // output results
-        writeResults(pl, centroids, centIdx, cout);
+        return 0;
+    } catch (const exception& e) {
+        cerr << e.what() << '\n';
+        return 1;
     }
-    return 0;
 }
 
 // End of source code
@@ -0,0 +1,242 @@
+/**
+ * Copyright (C) 2021 John Doll
+ *
+ * A distributed (MPI) version of the k-means program in main.cpp.
+ * The command-line arguments are the same as main.cpp, except that
+ * only "--threads N", "--deterministic", "--tolerance T", "--seed S",
+ * and "--stats" are supported.
+ *
+ * Each process loads its own part (shard) of the TSV or binary point
+ * file.  In each iteration, the processes assign their points locally
+ * and all_reduce the per-centroid sums and counts, so every process
+ * computes the same new centroids.  At the end, the points and their
+ * centroid indexes are gathered at rank 0 which prints them using
+ * writeResults().  The initial centroids are the same ones that
+ * getInitCentroid() picks in main.cpp, so the output matches main.cpp
+ * (up to the order in which floating-point sums are added).
+ *
+ * Compile and run (on a single machine) with:
+ *   $ mpicxx -std=c++17 -O3 -march=native -fopenmp -o main_mpi \
+ *         main_mpi.cpp KmeansHelper.cpp CentroidTable.cpp Lloyd.cpp \
+ *         Elkan.cpp KdTree.cpp PointStream.cpp -lboost_mpi \
+ *         -lboost_serialization
+ *   $ mpirun -np 4 ./main_mpi old_faithful.tsv 2 2
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+#include <boost/mpi.hpp>
+#include <boost/serialization/vector.hpp>
+#include "Kmeans.h"
+#include "PointArray.h"
+#include "PointStream.h"
+#include "Lloyd.h"
+
+// Some convenience namespaces to streamline code
+using namespace std;
+using namespace std::chrono_literals;
+namespace mpi = boost::mpi;
+
+/**
+ * Loads the part of the file to be processed by this process.
+ *
+ * \param[in] world The communicator whose rank and size determine
+ * the part to be loaded.
+ *
+ * \param[in] path The path to the TSV or binary point file.
+ *
+ * \param[in] numCols The number of columns to be used.
+ *
+ * \return The points in this process's part of the file.
+ */
+PointArray loadShard(const mpi::communicator& world, const string& path,
+                     const int numCols) {
+    PointStream stream(path, numCols, world.rank(), world.size());
+    PointArray points(0, stream.dims()), chunk;
+    while (stream.read(chunk, 8192) > 0) {
+        const size_t count = points.size();
+        points.resize(count + chunk.size());
+        copy_n(chunk[0], chunk.size() * chunk.dims(), points[count]);
+    }
+    return points;
+}
+
+/**
+ * Picks the initial centroids exactly like getInitCentroid() would
+ * for all the points in the file.  Rank 0 draws the global indexes of
+ * the points, and each process fills in the points it owns.
+ *
+ * \param[in] world The communicator for all the processes.
+ *
+ * \param[in] points The points loaded by this process.
+ *
+ * \param[in] numCentroids The number of centroids to be picked.
+ *
+ * \param[in] seed The seed for the random number generator.
+ *
+ * \return The initial centroids (the same on all processes).
+ */
+PointList initCentroids(const mpi::communicator& world,
+                        const PointArray& points, const int numCentroids,
+                        const unsigned seed) {
+    // Compute the global index of the first point on this process.
+    vector<long> counts;
+    mpi::all_gather(world, long(points.size()), counts);
+    const long first = accumulate(counts.begin(),
+                                  counts.begin() + world.rank(), 0L);
+    const long total = accumulate(counts.begin(), counts.end(), 0L);
+    // Rank 0 samples the global indexes of the points, which picks
+    // the same points as getInitCentroid() does.
+    vector<long> picked(min<long>(numCentroids, total));
+    if (world.rank() == 0) {
+        const vector<size_t> idx = sampleIndexes(total, picked.size(), seed);
+        copy(idx.begin(), idx.end(), picked.begin());
+    }
+    mpi::broadcast(world, picked, 0);
+    // Each process contributes the picked points that it owns.
+    const int dims = points.dims();
+    vector<double> local(picked.size() * dims, 0), global(local.size());
+    for (size_t c = 0; (c < picked.size()); c++) {
+        if ((picked[c] >= first) && (picked[c] < first + long(points.size()))) {
+            copy_n(points[picked[c] - first], dims, &local[c * dims]);
+        }
+    }
+    mpi::all_reduce(world, local.data(), local.size(), global.data(),
+                    plus<double>());
+    PointList centroids(picked.size());
+    for (size_t c = 0; (c < picked.size()); c++) {
+        centroids[c] = Point(&global[c * dims], dims);
+    }
+    return centroids;
+}
+
+/**
+ * Runs the Lloyd iterations across all the processes.
+ *
+ * \param[in] world The communicator for all the processes.
+ *
+ * \param[in] points The points loaded by this process.
+ *
+ * \param[in,out] centroids The initial centroids, updated to the
+ * final centroids.
+ *
+ * \param[in] opts The options for the local assignment passes.
+ *
+ * \param[out] iterations The number of iterations run.
+ *
+ * \return The index of the closest centroid for each local point.
+ */
+IntVec setClosestCentroid(const mpi::communicator& world,
+                          const PointArray& points, PointList& centroids,
+                          const LloydOptions& opts, int& iterations) {
+    IntVec centIdx(points.size());
+    CentroidTable table;
+    CentroidSums sums, global;
+    for (iterations = 0; (iterations < opts.maxIterations); ) {
+        // assign the local points and sum them up for each centroid
+        table.load(centroids);
+        lloydStep(points, table, centIdx, sums, opts);
+        iterations++;
+        // add up the sums from all processes
+        global = sums;
+        mpi::all_reduce(world, sums.sumValues().data(),
+                        sums.sumValues().size(),
+                        global.sumValues().data(), plus<double>());
+        mpi::all_reduce(world, sums.countValues().data(),
+                        sums.countValues().size(),
+                        global.countValues().data(), plus<long>());
+        // move each centroid to the mean of its points.  Every
+        // process computes the same centroids.
+        const PointList prevCentroids = centroids;
+        for (size_t c = 0; (c < centroids.size()); c++) {
+            global.computeNewCentroid(c, centroids[c]);
+        }
+        if (converged(prevCentroids, centroids, -1, opts)) {
+            break;
+        }
+    }
+    return centIdx;
+}
+
+int main(int argc, char *argv[]) {
+    mpi::environment env(argc, argv);
+    mpi::communicator world;
+    if (argc < 4) {
+        if (world.rank() == 0) {
+            cerr << "Usage: <TSVFile> <NumCols> <NumCentroids> [--threads N] "
+                 << "[--deterministic] [--tolerance T] [--seed S] "
+                 << "[--stats]\n";
+        }
+        return 1;
+    }
+    // Process the optional command-line arguments.
+    LloydOptions opts;
+    unsigned seed = default_random_engine::default_seed;
+    bool stats = false;
+    for (int i = 4; (i < argc); i++) {
+        const string arg = argv[i];
+        if (arg == "--threads" && (i + 1 < argc)) {
+            opts.threads = stoi(argv[++i]);
+        } else if (arg == "--deterministic") {
+            opts.deterministic = true;
+        } else if (arg == "--tolerance" && (i + 1 < argc)) {
+            opts.tolerance = stod(argv[++i]);
+        } else if (arg == "--seed" && (i + 1 < argc)) {
+            seed = stoul(argv[++i]);
+        } else if (arg == "--stats") {
+            stats = true;
+        } else {
+            throw invalid_argument("Invalid option: " + arg);
+        }
+    }
+
+    const auto startTime = chrono::high_resolution_clock::now();
+    const PointArray points = loadShard(world, argv[1], stoi(argv[2]));
+    const auto loadTime = chrono::high_resolution_clock::now();
+    PointList centroids;
+    IntVec centIdx;
+    int iterations = 0;
+    if (stoi(argv[3]) > 0) {
+        centroids = initCentroids(world, points, stoi(argv[3]), seed);
+        centIdx = setClosestCentroid(world, points, centroids, opts,
+                                     iterations);
+    }
+    const auto endTime = chrono::high_resolution_clock::now();
+
+    // Gather the points and centroid indexes (in file order) at rank 0.
+    const double* coords = points.size() ? points[0] : nullptr;
+    const vector<double> localCoords(coords,
+                                     coords + points.size() * points.dims());
+    vector<vector<double>> allCoords;
+    vector<IntVec> allIdx;
+    mpi::gather(world, localCoords, allCoords, 0);
+    mpi::gather(world, centIdx, allIdx, 0);
+    if (world.rank() == 0) {
+        PointList pl;
+        IntVec clsIdx;
+        for (int rank = 0; (rank < world.size()); rank++) {
+            for (size_t i = 0; (i < allCoords[rank].size());
+                 i += points.dims()) {
+                pl.push_back(Point(&allCoords[rank][i], points.dims()));
+            }
+            clsIdx.insert(clsIdx.end(), allIdx[rank].begin(),
+                          allIdx[rank].end());
+        }
+        if (stats) {
+            cerr << "Processes: " << world.size() << ", iterations: "
+                 << iterations << ", load time: "
+                 << ((loadTime - startTime) / 1ms) << " ms, cluster time: "
+                 << ((endTime - loadTime) / 1ms) << " ms\n";
+        }
+        writeResults(pl, centroids, clsIdx, cout);
+    }
+    return 0;
+}
+
+// End of source code
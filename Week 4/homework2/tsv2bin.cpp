@@ -0,0 +1,36 @@
+/**
+ * Copyright (C) 2021 John Doll
+ *
+ * Converts a TSV file of points to a binary point file (see
+ * PointStream.h) that main.cpp can read or memory-map (--mmap)
+ * without parsing the text each run.
+ *
+ * The command-line arguments are the TSV file, the number of columns
+ * to be used (as for main.cpp), and the binary file to be created.
+ *
+ * Compile and run with:
+ *   $ g++ -std=c++17 -O3 -o tsv2bin tsv2bin.cpp PointStream.cpp
+ *   $ ./tsv2bin old_faithful.tsv 2 old_faithful.bin
+ */
+
+#include <iostream>
+#include <string>
+#include "PointStream.h"
+
+// It is ok to use the following namespace delarations in C++ source
+// files only. They must never be used in header files.
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        cerr << "Usage: <TSVFile> <NumCols> <BinaryFile>\n";
+        return 1;
+    }
+    PointStream in(argv[1], stoi(argv[2]));
+    const uint64_t count = writePointFile(in, argv[3]);
+    cerr << "Wrote " << count << " points with " << in.dims()
+         << " dimensions to " << argv[3] << '\n';
+    return 0;
+}
+
+// End of source code
@@ -3,12 +3,76 @@
 #ifndef MATRIX_CPP
 #define MATRIX_CPP
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 #include "Matrix.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86
+#endif
+
 Matrix::Matrix(const size_t row, const size_t col, const Val initVal) :
-    std::vector<std::vector<Val>>(row, std::vector<Val>(col, initVal)) {
+    numRows(row), numCols(col),
+    rowStride((col >= PadCols) ? (col + 7) / 8 * 8 : col),
+    values(row * rowStride, 0) {
+    // Only the values in each row are set; the padding stays zero.
+    if (initVal != 0) {
+        for (size_t r = 0; r < numRows; r++) {
+            std::fill_n((*this)[r].data(), numCols, initVal);
+        }
+    }
+}
+
+Matrix::Matrix(Matrix&& other) noexcept :
+    numRows(std::exchange(other.numRows, 0)),
+    numCols(std::exchange(other.numCols, 0)),
+    rowStride(std::exchange(other.rowStride, 0)),
+    values(std::move(other.values)) {
+    // a moved-from vector need not be empty, so make sure it is
+    other.values.clear();
+}
+
+Matrix& Matrix::operator=(Matrix&& other) noexcept {
+    if (this != &other) {
+        numRows   = std::exchange(other.numRows, 0);
+        numCols   = std::exchange(other.numCols, 0);
+        rowStride = std::exchange(other.rowStride, 0);
+        values    = std::move(other.values);
+        other.values.clear();
+    }
+    return *this;
+}
+
+Matrix Matrix::uninitialized(const size_t rows, const size_t cols) {
+    Matrix result;
+    result.numRows   = rows;
+    result.numCols   = cols;
+    result.rowStride = (cols >= PadCols) ? (cols + 7) / 8 * 8 : cols;
+    // The allocator leaves the values uninitialized; only the padding
+    // is set to zero.
+    result.values.resize(rows * result.rowStride);
+    for (size_t r = 0; r < rows && cols < result.rowStride; r++) {
+        std::fill(result[r].end(), result[r].data() + result.rowStride, 0);
+    }
+    return result;
 }
 
 // input stream operator overload
@@ -18,126 +82,1156 @@ operator>>(std::istream& is, Matrix& matrix) {
     int rows, cols;
     is >> rows >> cols;
 
-    // for each row in the matrix, add a vector (column)
+    // allocate all the rows at once and then read each value
+    matrix = Matrix(rows, cols);
     for (int i = 0; i < rows; i++) {
-        matrix.push_back(std::vector<Val>());
-        for (int j = 0; j < cols; j++) {
-            // at each location, get the value from the istream and add it to
-            // the matrix
-            Val val;
+        for (auto& val : matrix[i]) {
+            // at each location, get the value from the istream
             is >> val;
-            matrix[i].push_back(val);
         }
     }
     return is;
 }
 
-// addition operator overload
-Matrix
-Matrix::operator+(const Matrix& rhs) const {
-    // if dimensions are different, throw exception
-    if (rhs.height() != this->height() || rhs.width() != this->width()) {
-        throw std::exception();
+/** The header of a binary matrix file (see Matrix::writeBinary()) */
+struct BinaryHeader {
+    char magic[8];
+    uint32_t version, byteOrder, type, unused1;
+    uint64_t rows, cols, stride, dataOffset, unused2;
+};
+
+static_assert(sizeof(BinaryHeader) == 64, "The header must be 64 bytes");
+static_assert(sizeof(Val) == 8, "Only doubles are read and written");
+
+constexpr char BinaryMagic[8] = {'M', 'A', 'T', 'R', 'X', 'B', 'I', 'N'};
+constexpr uint32_t BinaryVersion = 1, BinaryByteOrder = 0x01020304;
+constexpr uint32_t BinaryDouble = 1;
+
+void Matrix::writeBinary(const std::string& path) const {
+    std::ofstream os(path, std::ios::binary);
+    if (!os) {
+        throw std::runtime_error("Error opening file " + path);
+    }
+    BinaryHeader hdr = {};
+    std::copy_n(BinaryMagic, sizeof(hdr.magic), hdr.magic);
+    hdr.version    = BinaryVersion;
+    hdr.byteOrder  = BinaryByteOrder;
+    hdr.type       = BinaryDouble;
+    hdr.rows       = numRows;
+    hdr.cols       = numCols;
+    hdr.stride     = rowStride;
+    hdr.dataOffset = sizeof(hdr);
+    // the values follow the header as they are, padding and all
+    os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    os.write(reinterpret_cast<const char*>(data()),
+             values.size() * sizeof(Val));
+    if (!os) {
+        throw std::runtime_error("Error writing file " + path);
+    }
+}
+
+/**
+ * A file mapped read-only into memory.  It is unmapped when this
+ * object is destroyed, so that it is not leaked when the contents
+ * turn out to be invalid.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Error opening file " + path);
+        }
+        struct stat info;
+        if ((fstat(fd, &info) == 0) && (info.st_size > 0)) {
+            size = info.st_size;
+            // the whole file is about to be read, so its pages are
+            // loaded up front where the OS supports that
+            int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            flags |= MAP_POPULATE;
+#endif
+            addr = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        }
+        // the mapping stays valid after the file is closed
+        close(fd);
+        if ((size > 0) && (addr == MAP_FAILED)) {
+            throw std::runtime_error("Error reading file " + path);
+        }
+    }
+
+    ~MappedFile() {
+        if (addr != MAP_FAILED) {
+            munmap(addr, size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /** The contents of the file (nullptr if it is empty) */
+    const char* data() const {
+        return (addr != MAP_FAILED) ? static_cast<const char*>(addr) :
+            nullptr;
+    }
+
+    /** The size of the file in bytes */
+    size_t size = 0;
+
+private:
+    void* addr = MAP_FAILED;
+};
+
+Matrix Matrix::readBinary(const std::string& path) {
+    const MappedFile file(path);
+    BinaryHeader hdr;
+    if ((file.size < sizeof(hdr)) ||
+        !std::equal(BinaryMagic, BinaryMagic + sizeof(hdr.magic),
+                    file.data())) {
+        throw std::runtime_error(path + " is not a binary matrix file");
+    }
+    // copy the header, as the mapping may not be aligned for it
+    std::memcpy(&hdr, file.data(), sizeof(hdr));
+    if (hdr.byteOrder != BinaryByteOrder) {
+        throw std::runtime_error(path + " was written on a machine with "
+                                 "a different byte order");
+    }
+    if ((hdr.version != BinaryVersion) || (hdr.type != BinaryDouble)) {
+        throw std::runtime_error(path + " has an unsupported version or "
+                                 "type of values");
+    }
+    // the values must fit in the file (the last row needs only cols
+    // values), which also keeps the sizes below from overflowing
+    const uint64_t avail = (hdr.dataOffset <= file.size) ?
+        (file.size - hdr.dataOffset) / sizeof(Val) : 0;
+    const bool fits = (hdr.rows == 0) ||
+        ((hdr.rows - 1 <= avail / std::max<uint64_t>(hdr.stride, 1)) &&
+         ((hdr.rows - 1) * hdr.stride + hdr.cols <= avail));
+    if ((hdr.dataOffset < sizeof(hdr)) || (hdr.cols > hdr.stride) ||
+        !fits) {
+        throw std::runtime_error(path + " is truncated or corrupt");
     }
-    // create return matrix
-    Matrix ret(rhs.height(), rhs.width());
-    for (int i = 0; i < rhs.height(); i++) {
-        for (int j = 0; j < rhs.width(); j++) {
-            // add matrices together
-            ret[i][j] = (*this)[i][j] + rhs[i][j];
+    // copy the rows (without the padding, which stays zero) into the
+    // new matrix; a matrix without padding is copied all at once
+    Matrix ret = uninitialized(hdr.rows, hdr.cols);
+    const char* vals = file.data() + hdr.dataOffset;
+    if ((hdr.stride == hdr.cols) && (ret.rowStride == ret.numCols)) {
+        std::memcpy(ret.data(), vals, ret.values.size() * sizeof(Val));
+    } else {
+        for (size_t r = 0; r < ret.numRows; r++) {
+            std::memcpy(ret[r].data(), vals + r * hdr.stride * sizeof(Val),
+                        ret.numCols * sizeof(Val));
         }
     }
     return ret;
 }
 
-// subtraction operator overload
-Matrix
-Matrix::operator-(const Matrix& rhs) const {
-    // if dimensions are different, throw exception
-    if (rhs.height() != this->height() || rhs.width() != this->width()) {
-        throw std::exception();
+bool Matrix::isBinaryFile(const std::string& path) {
+    const std::string binExt = ".bin";
+    return (path.size() > binExt.size()) &&
+        (path.compare(path.size() - binExt.size(), binExt.size(),
+                      binExt) == 0);
+}
+
+// ------------------------------------------------------------------
+// The kernels used by the element-wise operators and dot().  Each
+// instruction set has its own set of kernels, and the best one that
+// the CPU supports is picked when the first matrix operation runs
+// (see Matrix::setSimd()).  The element-wise kernels compute each
+// value with the same IEEE operation as the scalar loop, so their
+// results are identical.  The dot() kernels use fused multiply-adds
+// and sum the products in a different order, so each value may differ
+// from the scalar kernel by a few units in the last place times the
+// number of terms -- at most k * 2^-52 * sum(|a_ik * b_kj|) for a
+// sum of k products.
+// ------------------------------------------------------------------
+
+/** The element-wise operations that have kernels */
+enum class ElemOp { Add, Sub, Mul };
+
+/**
+ * The kernels for one instruction set.  The element-wise kernels
+ * work on n consecutive values and may be called with res equal to
+ * lhs.  axpy adds scale * x to res, and dot returns the sum of the
+ * products of the values of lhs and rhs.  tile adds the product of
+ * a packed mr-row panel and a packed nr-column panel (see packLhs()
+ * and packRhs()) to an mr x nr tile.  transpose writes the transpose
+ * of the tb x tb block at src, whose rows are lds values apart, to
+ * dest, whose rows are ldd values apart.
+ */
+struct Kernels {
+    const char* name;
+    void (*add)(const Val* lhs, const Val* rhs, Val* res, size_t n);
+    void (*sub)(const Val* lhs, const Val* rhs, Val* res, size_t n);
+    void (*mul)(const Val* lhs, const Val* rhs, Val* res, size_t n);
+    void (*scale)(const Val* lhs, Val val, Val* res, size_t n);
+    void (*axpy)(Val scale, const Val* x, Val* res, size_t n);
+    Val (*dot)(const Val* lhs, const Val* rhs, size_t n);
+    size_t mr, nr;
+    void (*tile)(size_t depth, const Val* lhs, const Val* rhs, Val* res,
+                 size_t ld);
+    size_t tb;
+    void (*transpose)(const Val* src, size_t lds, Val* dest, size_t ldd);
+};
+
+/** Applies an element-wise operation to two values. */
+template<ElemOp Op>
+static inline Val elemOp(const Val lhs, const Val rhs) {
+    if constexpr (Op == ElemOp::Add) {
+        return lhs + rhs;
+    } else if constexpr (Op == ElemOp::Sub) {
+        return lhs - rhs;
+    } else {
+        return lhs * rhs;
     }
-    // create return matrix
-    Matrix ret(rhs.height(), rhs.width());
-    for (int i = 0; i < rhs.height(); i++) {
-        for (int j = 0; j < rhs.width(); j++) {
-            // subtract matrice values
-            ret[i][j] = (*this)[i][j] - rhs[i][j];
+}
+
+template<ElemOp Op>
+static void scalarBinary(const Val* lhs, const Val* rhs, Val* res,
+                         const size_t n) {
+    for (size_t i = 0; (i < n); i++) {
+        res[i] = elemOp<Op>(lhs[i], rhs[i]);
+    }
+}
+
+static void scalarScale(const Val* lhs, const Val val, Val* res,
+                        const size_t n) {
+    for (size_t i = 0; (i < n); i++) {
+        res[i] = lhs[i] * val;
+    }
+}
+
+static void scalarAxpy(const Val scale, const Val* x, Val* res,
+                       const size_t n) {
+    for (size_t i = 0; (i < n); i++) {
+        res[i] += scale * x[i];
+    }
+}
+
+static Val scalarDot(const Val* lhs, const Val* rhs, const size_t n) {
+    Val sum = 0;
+    for (size_t i = 0; (i < n); i++) {
+        sum += lhs[i] * rhs[i];
+    }
+    return sum;
+}
+
+/**
+ * The portable tile kernel.  The 6 x 8 tile is accumulated in a local
+ * array that the compiler keeps in vector registers.
+ */
+static void scalarTile(const size_t depth, const Val* lhs, const Val* rhs,
+                       Val* res, const size_t ld) {
+    constexpr size_t MR = 6, NR = 8;
+    Val acc[MR][NR] = {};
+    for (size_t p = 0; (p < depth); p++, lhs += MR, rhs += NR) {
+        for (size_t i = 0; (i < MR); i++) {
+            for (size_t j = 0; (j < NR); j++) {
+                acc[i][j] += lhs[i] * rhs[j];
+            }
+        }
+    }
+    for (size_t i = 0; (i < MR); i++) {
+        for (size_t j = 0; (j < NR); j++) {
+            res[i * ld + j] += acc[i][j];
         }
     }
-    return ret;
 }
 
-// multiplication operator overload
-Matrix
-Matrix::operator*(const Matrix& rhs) const {
-    // if dimensions are different, throw exception
-    if (rhs.height() != this->height() || rhs.width() != this->width()) {
-        throw std::exception();
+/** The portable block transpose, on 4 x 4 blocks. */
+static void scalarTranspose(const Val* src, const size_t lds, Val* dest,
+                            const size_t ldd) {
+    constexpr size_t TB = 4;
+    for (size_t i = 0; (i < TB); i++) {
+        for (size_t j = 0; (j < TB); j++) {
+            dest[j * ldd + i] = src[i * lds + j];
+        }
+    }
+}
+
+static const Kernels ScalarKernels = {
+    "scalar", scalarBinary<ElemOp::Add>, scalarBinary<ElemOp::Sub>,
+    scalarBinary<ElemOp::Mul>, scalarScale, scalarAxpy, scalarDot, 6, 8,
+    scalarTile, 4, scalarTranspose
+};
+
+#ifdef MATRIX_X86
+
+template<ElemOp Op>
+__attribute__((target("avx2,fma")))
+static void avx2Binary(const Val* lhs, const Val* rhs, Val* res,
+                       const size_t n) {
+    size_t i = 0;
+    for (; (i + 4 <= n); i += 4) {
+        const __m256d a = _mm256_loadu_pd(lhs + i);
+        const __m256d b = _mm256_loadu_pd(rhs + i);
+        if constexpr (Op == ElemOp::Add) {
+            _mm256_storeu_pd(res + i, _mm256_add_pd(a, b));
+        } else if constexpr (Op == ElemOp::Sub) {
+            _mm256_storeu_pd(res + i, _mm256_sub_pd(a, b));
+        } else {
+            _mm256_storeu_pd(res + i, _mm256_mul_pd(a, b));
+        }
+    }
+    for (; (i < n); i++) {
+        res[i] = elemOp<Op>(lhs[i], rhs[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Scale(const Val* lhs, const Val val, Val* res,
+                      const size_t n) {
+    const __m256d v = _mm256_set1_pd(val);
+    size_t i = 0;
+    for (; (i + 4 <= n); i += 4) {
+        _mm256_storeu_pd(res + i, _mm256_mul_pd(_mm256_loadu_pd(lhs + i), v));
     }
-    // create return matrix
-    Matrix ret(rhs.height(), rhs.width());
-    for (int i = 0; i < rhs.height(); i++) {
-        for (int j = 0; j < rhs.width(); j++) {
-            // multiply matrice values
-            ret[i][j] = (*this)[i][j] * rhs[i][j];
+    for (; (i < n); i++) {
+        res[i] = lhs[i] * val;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Axpy(const Val scale, const Val* x, Val* res,
+                     const size_t n) {
+    const __m256d s = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; (i + 4 <= n); i += 4) {
+        _mm256_storeu_pd(res + i, _mm256_fmadd_pd(s, _mm256_loadu_pd(x + i),
+                                                  _mm256_loadu_pd(res + i)));
+    }
+    for (; (i < n); i++) {
+        res[i] += scale * x[i];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static Val avx2Dot(const Val* lhs, const Val* rhs, const size_t n) {
+    // Two accumulators hide some of the latency of the additions.
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; (i + 8 <= n); i += 8) {
+        sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(lhs + i),
+                               _mm256_loadu_pd(rhs + i), sum0);
+        sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(lhs + i + 4),
+                               _mm256_loadu_pd(rhs + i + 4), sum1);
+    }
+    alignas(32) Val parts[4];
+    _mm256_store_pd(parts, _mm256_add_pd(sum0, sum1));
+    Val sum = (parts[0] + parts[1]) + (parts[2] + parts[3]);
+    for (; (i < n); i++) {
+        sum += lhs[i] * rhs[i];
+    }
+    return sum;
+}
+
+/**
+ * The AVX2 tile kernel: a 6 x 8 tile in 12 ymm accumulators, with
+ * each value of the lhs panel broadcast to multiply two vectors of
+ * the rhs panel.
+ */
+__attribute__((target("avx2,fma")))
+static void avx2Tile(const size_t depth, const Val* lhs, const Val* rhs,
+                     Val* res, const size_t ld) {
+    constexpr int MR = 6;
+    __m256d acc[MR][2];
+    // The loops over the rows are unrolled so that acc stays in
+    // registers instead of being stored to the stack every step.
+#pragma GCC unroll 12
+    for (int i = 0; (i < MR); i++) {
+        acc[i][0] = acc[i][1] = _mm256_setzero_pd();
+    }
+    for (size_t p = 0; (p < depth); p++, lhs += MR, rhs += 8) {
+        const __m256d b0 = _mm256_loadu_pd(rhs);
+        const __m256d b1 = _mm256_loadu_pd(rhs + 4);
+#pragma GCC unroll 12
+        for (int i = 0; (i < MR); i++) {
+            const __m256d a = _mm256_broadcast_sd(lhs + i);
+            acc[i][0] = _mm256_fmadd_pd(a, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_pd(a, b1, acc[i][1]);
         }
     }
+#pragma GCC unroll 12
+    for (int i = 0; (i < MR); i++, res += ld) {
+        _mm256_storeu_pd(res, _mm256_add_pd(_mm256_loadu_pd(res), acc[i][0]));
+        _mm256_storeu_pd(res + 4, _mm256_add_pd(_mm256_loadu_pd(res + 4),
+                                                acc[i][1]));
+    }
+}
+
+/**
+ * The AVX2 block transpose: a 4 x 4 block is loaded into 4 ymm
+ * registers, transposed by interleaving the pairs of rows and then
+ * swapping the 128-bit halves, and stored as 4 rows.
+ */
+__attribute__((target("avx2,fma")))
+static void avx2Transpose(const Val* src, const size_t lds, Val* dest,
+                          const size_t ldd) {
+    const __m256d r0 = _mm256_loadu_pd(src);
+    const __m256d r1 = _mm256_loadu_pd(src + lds);
+    const __m256d r2 = _mm256_loadu_pd(src + 2 * lds);
+    const __m256d r3 = _mm256_loadu_pd(src + 3 * lds);
+    // t0 = r0[0] r1[0] r0[2] r1[2], t1 = r0[1] r1[1] r0[3] r1[3], ...
+    const __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+    const __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+    const __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+    const __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+    _mm256_storeu_pd(dest, _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(dest + ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(dest + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(dest + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+
+static const Kernels Avx2Kernels = {
+    "avx2", avx2Binary<ElemOp::Add>, avx2Binary<ElemOp::Sub>,
+    avx2Binary<ElemOp::Mul>, avx2Scale, avx2Axpy, avx2Dot, 6, 8, avx2Tile,
+    4, avx2Transpose
+};
+
+template<ElemOp Op>
+__attribute__((target("avx512f")))
+static void avx512Binary(const Val* lhs, const Val* rhs, Val* res,
+                         const size_t n) {
+    for (size_t i = 0; (i < n); i += 8) {
+        // The last (partial) vector is masked.
+        const __mmask8 mask = (n - i >= 8) ? 0xFF : (1u << (n - i)) - 1;
+        const __m512d a = _mm512_maskz_loadu_pd(mask, lhs + i);
+        const __m512d b = _mm512_maskz_loadu_pd(mask, rhs + i);
+        if constexpr (Op == ElemOp::Add) {
+            _mm512_mask_storeu_pd(res + i, mask, _mm512_add_pd(a, b));
+        } else if constexpr (Op == ElemOp::Sub) {
+            _mm512_mask_storeu_pd(res + i, mask, _mm512_sub_pd(a, b));
+        } else {
+            _mm512_mask_storeu_pd(res + i, mask, _mm512_mul_pd(a, b));
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512Scale(const Val* lhs, const Val val, Val* res,
+                        const size_t n) {
+    const __m512d v = _mm512_set1_pd(val);
+    for (size_t i = 0; (i < n); i += 8) {
+        const __mmask8 mask = (n - i >= 8) ? 0xFF : (1u << (n - i)) - 1;
+        _mm512_mask_storeu_pd(res + i, mask, _mm512_mul_pd(
+                                  _mm512_maskz_loadu_pd(mask, lhs + i), v));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void avx512Axpy(const Val scale, const Val* x, Val* res,
+                       const size_t n) {
+    const __m512d s = _mm512_set1_pd(scale);
+    for (size_t i = 0; (i < n); i += 8) {
+        const __mmask8 mask = (n - i >= 8) ? 0xFF : (1u << (n - i)) - 1;
+        _mm512_mask_storeu_pd(res + i, mask, _mm512_fmadd_pd(
+                                  s, _mm512_maskz_loadu_pd(mask, x + i),
+                                  _mm512_maskz_loadu_pd(mask, res + i)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static Val avx512Dot(const Val* lhs, const Val* rhs, const size_t n) {
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; (i + 16 <= n); i += 16) {
+        sum0 = _mm512_fmadd_pd(_mm512_loadu_pd(lhs + i),
+                               _mm512_loadu_pd(rhs + i), sum0);
+        sum1 = _mm512_fmadd_pd(_mm512_loadu_pd(lhs + i + 8),
+                               _mm512_loadu_pd(rhs + i + 8), sum1);
+    }
+    for (; (i < n); i += 8) {
+        const __mmask8 mask = (n - i >= 8) ? 0xFF : (1u << (n - i)) - 1;
+        sum0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, lhs + i),
+                               _mm512_maskz_loadu_pd(mask, rhs + i), sum0);
+    }
+    alignas(64) Val parts[8];
+    _mm512_store_pd(parts, _mm512_add_pd(sum0, sum1));
+    return ((parts[0] + parts[1]) + (parts[2] + parts[3])) +
+        ((parts[4] + parts[5]) + (parts[6] + parts[7]));
+}
+
+/**
+ * The AVX-512 tile kernel: a 12 x 16 tile in 24 zmm accumulators, so
+ * that enough independent multiply-adds are in flight to keep both
+ * FMA units busy.
+ */
+__attribute__((target("avx512f")))
+static void avx512Tile(const size_t depth, const Val* lhs, const Val* rhs,
+                       Val* res, const size_t ld) {
+    constexpr int MR = 12;
+    __m512d acc[MR][2];
+#pragma GCC unroll 12
+    for (int i = 0; (i < MR); i++) {
+        acc[i][0] = acc[i][1] = _mm512_setzero_pd();
+    }
+    for (size_t p = 0; (p < depth); p++, lhs += MR, rhs += 16) {
+        const __m512d b0 = _mm512_loadu_pd(rhs);
+        const __m512d b1 = _mm512_loadu_pd(rhs + 8);
+#pragma GCC unroll 12
+        for (int i = 0; (i < MR); i++) {
+            const __m512d a = _mm512_set1_pd(lhs[i]);
+            acc[i][0] = _mm512_fmadd_pd(a, b0, acc[i][0]);
+            acc[i][1] = _mm512_fmadd_pd(a, b1, acc[i][1]);
+        }
+    }
+#pragma GCC unroll 12
+    for (int i = 0; (i < MR); i++, res += ld) {
+        _mm512_storeu_pd(res, _mm512_add_pd(_mm512_loadu_pd(res), acc[i][0]));
+        _mm512_storeu_pd(res + 8, _mm512_add_pd(_mm512_loadu_pd(res + 8),
+                                                acc[i][1]));
+    }
+}
+
+/**
+ * The AVX-512 block transpose: an 8 x 8 block is loaded into 8 zmm
+ * registers and transposed in three rounds, each of which picks
+ * values from pairs of registers: the first leaves the 2 x 2 blocks
+ * transposed, the second the 4 x 4 blocks, and the third the whole
+ * block.
+ */
+__attribute__((target("avx512f")))
+static void avx512Transpose(const Val* src, const size_t lds, Val* dest,
+                            const size_t ldd) {
+    // The values picked from a and b (indices 8-15) by each round,
+    // for the even and the odd registers of each pair.
+    const __m512i lo1 = _mm512_setr_epi64(0, 8, 2, 10, 4, 12, 6, 14);
+    const __m512i hi1 = _mm512_setr_epi64(1, 9, 3, 11, 5, 13, 7, 15);
+    const __m512i lo2 = _mm512_setr_epi64(0, 1, 8, 9, 4, 5, 12, 13);
+    const __m512i hi2 = _mm512_setr_epi64(2, 3, 10, 11, 6, 7, 14, 15);
+    const __m512i lo3 = _mm512_setr_epi64(0, 1, 2, 3, 8, 9, 10, 11);
+    const __m512i hi3 = _mm512_setr_epi64(4, 5, 6, 7, 12, 13, 14, 15);
+    __m512d row[8], tmp[8];
+#pragma GCC unroll 8
+    for (int i = 0; (i < 8); i++) {
+        row[i] = _mm512_loadu_pd(src + i * lds);
+    }
+    // Registers i and i + 1, i + 2, and i + 4 are paired in the
+    // three rounds.
+#pragma GCC unroll 8
+    for (int i = 0; (i < 8); i += 2) {
+        tmp[i]     = _mm512_permutex2var_pd(row[i], lo1, row[i + 1]);
+        tmp[i + 1] = _mm512_permutex2var_pd(row[i], hi1, row[i + 1]);
+    }
+#pragma GCC unroll 8
+    for (int half = 0; (half < 8); half += 4) {
+        for (int i = half; (i < half + 2); i++) {
+            row[i]     = _mm512_permutex2var_pd(tmp[i], lo2, tmp[i + 2]);
+            row[i + 2] = _mm512_permutex2var_pd(tmp[i], hi2, tmp[i + 2]);
+        }
+    }
+#pragma GCC unroll 8
+    for (int i = 0; (i < 4); i++) {
+        _mm512_storeu_pd(dest + i * ldd,
+                         _mm512_permutex2var_pd(row[i], lo3, row[i + 4]));
+        _mm512_storeu_pd(dest + (i + 4) * ldd,
+                         _mm512_permutex2var_pd(row[i], hi3, row[i + 4]));
+    }
+}
+
+static const Kernels Avx512Kernels = {
+    "avx512", avx512Binary<ElemOp::Add>, avx512Binary<ElemOp::Sub>,
+    avx512Binary<ElemOp::Mul>, avx512Scale, avx512Axpy, avx512Dot, 12, 16,
+    avx512Tile, 8, avx512Transpose
+};
+
+#endif
+
+/**
+ * Returns the kernels for an instruction set, or nullptr if it is
+ * unknown or not supported by this CPU.
+ */
+static const Kernels* findKernels(const std::string& isa) {
+#ifdef MATRIX_X86
+    if ((isa == "avx512") && __builtin_cpu_supports("avx512f")) {
+        return &Avx512Kernels;
+    }
+    if ((isa == "avx2") && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma")) {
+        return &Avx2Kernels;
+    }
+#endif
+    return (isa == "scalar") ? &ScalarKernels : nullptr;
+}
+
+/**
+ * Returns a reference to the kernels in use.  They are picked the
+ * first time: the MATRIX_SIMD environment variable, if set, and
+ * otherwise the best kernels the CPU supports.
+ */
+static const Kernels*& kernels() {
+    static const Kernels* current = [] {
+        const char* env = std::getenv("MATRIX_SIMD");
+        if (env != nullptr) {
+            if (const Kernels* chosen = findKernels(env)) {
+                return chosen;
+            }
+        }
+        for (const char* isa : {"avx512", "avx2"}) {
+            if (const Kernels* best = findKernels(isa)) {
+                return best;
+            }
+        }
+        return &ScalarKernels;
+    }();
+    return current;
+}
+
+std::string Matrix::simd() {
+    return kernels()->name;
+}
+
+bool Matrix::setSimd(const std::string& isa) {
+    const Kernels* chosen = findKernels(isa);
+    if (chosen != nullptr) {
+        kernels() = chosen;
+    }
+    return chosen != nullptr;
+}
+
+/** The number of threads set with Matrix::setThreads(), or zero */
+static int threadSetting = 0;
+
+int Matrix::threads() {
+#ifdef _OPENMP
+    static const int envThreads = [] {
+        const char* env = std::getenv("MATRIX_THREADS");
+        return (env != nullptr) ? std::atoi(env) : 0;
+    }();
+    const int count = (threadSetting > 0) ? threadSetting : envThreads;
+    return (count > 0) ? count : omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+void Matrix::setThreads(const int count) {
+    threadSetting = std::max(count, 0);
+}
+
+int Matrix::threadsFor(const size_t work, const size_t minWork) {
+    return int(std::max<size_t>(1, std::min<size_t>(threads(),
+                                                     work / minWork)));
+}
+
+// The least number of values an element-wise operation or transpose
+// must have to be split between threads (for each thread).
+constexpr size_t ParallelVals = 1 << 16;
+
+// The least number of multiply-adds that dot() gives each thread.
+constexpr size_t ParallelOps = 64 * 64 * 64;
+
+/**
+ * Applies an element-wise kernel to every value of a matrix.  Without
+ * padding the whole buffer is one run of values; otherwise each row
+ * is processed separately so that the padding stays zero.
+ */
+template<typename Kernel>
+static void forEachRun(const Matrix& mat, const Kernel& kernel) {
+    const size_t rows = mat.height(), cols = mat.width();
+    const int threads = Matrix::threadsFor(rows * cols, ParallelVals);
+    if (mat.stride() == cols) {
+        // Each thread gets one run, a multiple of 8 values long so
+        // that the threads do not write to the same cache line.
+        const size_t total = rows * cols;
+        const size_t chunk = ((total + threads - 1) / threads + 7) / 8 * 8;
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (int t = 0; (t < threads); t++) {
+            const size_t start = std::min(total, t * chunk);
+            const size_t count = std::min(chunk, total - start);
+            if (count > 0) {
+                kernel(start, count);
+            }
+        }
+    } else {
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (size_t r = 0; (r < rows); r++) {
+            kernel(r * mat.stride(), cols);
+        }
+    }
+}
+
+void Matrix::elementwise(const Matrix& lhs, const Matrix& rhs,
+                         const int op, Matrix& result) {
+    // if dimensions are different, throw exception
+    if (rhs.height() != lhs.height() || rhs.width() != lhs.width()) {
+        throw std::exception();
+    }
+    const Kernels& k = *kernels();
+    const auto kernel = (op == int(ElemOp::Add)) ? k.add :
+        ((op == int(ElemOp::Sub)) ? k.sub : k.mul);
+    // apply the kernel to each value
+    forEachRun(lhs, [&](const size_t start, const size_t count) {
+        kernel(lhs.data() + start, rhs.data() + start,
+               result.data() + start, count);
+    });
+}
+
+// addition operator overload
+Matrix
+Matrix::operator+(const Matrix& rhs) const& {
+    Matrix ret = uninitialized(numRows, numCols);
+    elementwise(*this, rhs, int(ElemOp::Add), ret);
     return ret;
 }
 
+Matrix
+Matrix::operator+(const Matrix& rhs) && {
+    return std::move(*this += rhs);
+}
+
+Matrix& Matrix::operator+=(const Matrix& rhs) {
+    elementwise(*this, rhs, int(ElemOp::Add), *this);
+    return *this;
+}
+
+// subtraction operator overload
+Matrix
+Matrix::operator-(const Matrix& rhs) const& {
+    Matrix ret = uninitialized(numRows, numCols);
+    elementwise(*this, rhs, int(ElemOp::Sub), ret);
+    return ret;
+}
+
+Matrix
+Matrix::operator-(const Matrix& rhs) && {
+    return std::move(*this -= rhs);
+}
+
+Matrix& Matrix::operator-=(const Matrix& rhs) {
+    elementwise(*this, rhs, int(ElemOp::Sub), *this);
+    return *this;
+}
+
+// multiplication operator overload
+Matrix
+Matrix::operator*(const Matrix& rhs) const& {
+    Matrix ret = uninitialized(numRows, numCols);
+    elementwise(*this, rhs, int(ElemOp::Mul), ret);
+    return ret;
+}
+
+Matrix
+Matrix::operator*(const Matrix& rhs) && {
+    return std::move(*this *= rhs);
+}
+
+Matrix& Matrix::operator*=(const Matrix& rhs) {
+    elementwise(*this, rhs, int(ElemOp::Mul), *this);
+    return *this;
+}
+
 // multiply matrix by given value
 Matrix
-Matrix::operator*(const Val val) const {
-    Matrix ret(this->height(), this->width());
-    for (int i = 0; i < this->height(); i++) {
-        for (int j = 0; j < this->width(); j++) {
-            // multiply matrix by given value at each location
-            ret[i][j] = (*this)[i][j] * val;
+Matrix::operator*(const Val val) const& {
+    const auto scale = kernels()->scale;
+    Matrix ret = uninitialized(numRows, numCols);
+    forEachRun(*this, [&](const size_t start, const size_t count) {
+        scale(data() + start, val, ret.data() + start, count);
+    });
+    return ret;
+}
+
+Matrix
+Matrix::operator*(const Val val) && {
+    return std::move(*this *= val);
+}
+
+Matrix& Matrix::operator*=(const Val val) {
+    const auto scale = kernels()->scale;
+    forEachRun(*this, [&](const size_t start, const size_t count) {
+        scale(data() + start, val, data() + start, count);
+    });
+    return *this;
+}
+
+// The blocking used by dot() for large matrices.  The product is
+// computed in mr x nr tiles of the result, each held in registers by
+// the tile kernel while it walks a KC-long slice of a packed mr-row
+// panel of the lhs and a packed nr-column panel of the rhs.  The
+// KC x nr rhs panel stays in the L1 cache, the MC x KC block of the
+// lhs in the L2 cache, and the KC x NC block of the rhs in the L3
+// cache (Goto and van de Geijn, "Anatomy of high-performance matrix
+// multiplication", 2008).  MC and NC are multiples of every mr and
+// nr.
+constexpr size_t KC = 256, MC = 120, NC = 2048;
+
+// Products with fewer multiply-adds (or narrower results) than these
+// use the simple row-by-row loop, as packing would cost more than it
+// saves.
+constexpr size_t MinGemmOps = 32 * 32 * 32;
+
+/**
+ * Copies a block of the lhs into panels of mr rows.  Within a panel
+ * the mr values of each column are consecutive, so the kernel reads
+ * the panel sequentially.  Rows past the end are filled with zeros.
+ * If trans is true the block is read from the transpose of the lhs,
+ * i.e., src is depth x rows and each panel column is a contiguous
+ * run of a row of src.
+ */
+static void packLhs(const Val* src, const size_t ld, const bool trans,
+                    const size_t rows, const size_t depth, const size_t mr,
+                    Val* dest) {
+    for (size_t i = 0; (i < rows); i += mr) {
+        const size_t valid = std::min(mr, rows - i);
+        for (size_t p = 0; (p < depth); p++) {
+            for (size_t r = 0; (r < mr); r++) {
+                const Val* val = trans ? &src[p * ld + i + r] :
+                    &src[(i + r) * ld + p];
+                *dest++ = (r < valid) ? *val : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Copies a block of the rhs into panels of nr columns, with the nr
+ * values of each row consecutive.  Columns past the end are filled
+ * with zeros.  If trans is true the block is read from the transpose
+ * of the rhs, i.e., src is cols x depth.  Each row of src is then
+ * read sequentially and scattered into one column of the panel,
+ * which is small enough to stay in the L1 cache.
+ */
+static void packRhs(const Val* src, const size_t ld, const bool trans,
+                    const size_t depth, const size_t cols, const size_t nr,
+                    Val* dest) {
+    for (size_t j = 0; (j < cols); j += nr, dest += depth * nr) {
+        const size_t valid = std::min(nr, cols - j);
+        for (size_t p = 0; (p < depth) && !trans; p++) {
+            const Val* row = src + p * ld + j;
+            for (size_t c = 0; (c < nr); c++) {
+                dest[p * nr + c] = (c < valid) ? row[c] : 0;
+            }
+        }
+        for (size_t c = 0; (c < nr) && trans; c++) {
+            const Val* row = src + (j + std::min(c, valid - 1)) * ld;
+            for (size_t p = 0; (p < depth); p++) {
+                dest[p * nr + c] = (c < valid) ? row[p] : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Adds lhs (m x k) times rhs (k x n) to res (m x n), using packed,
+ * cache-sized blocks and the register-tiled kernel.  If transLhs
+ * (transRhs) is true, lhs (rhs) holds the transpose of the operand;
+ * it is transposed while packing.  The blocks of the lhs (and so the
+ * rows of the result) are split between threads, which share each
+ * packed block of the rhs.
+ */
+static void gemm(const size_t m, const size_t n, const size_t k,
+                 const Val* lhs, const size_t ldl, const bool transLhs,
+                 const Val* rhs, const size_t ldr, const bool transRhs,
+                 Val* res, const size_t ldres) {
+    const Kernels& kern = *kernels();
+    const size_t MR = kern.mr, NR = kern.nr;
+    const int threads = Matrix::threadsFor(m * n * k, ParallelOps);
+    // The packed blocks are kept for the next call on this thread.
+    // The rhs block of the calling thread is used by all threads.
+    thread_local std::vector<Val, AlignedAllocator<Val>> lhsPack, rhsPack;
+    rhsPack.resize(std::max(rhsPack.size(), KC * NC));
+    Val* const rhsBlock = rhsPack.data();
+    // Use smaller lhs blocks if there are too few rows to give each
+    // thread one.
+    const size_t mcMax = std::min(MC, ((m + threads - 1) / threads +
+                                       MR - 1) / MR * MR);
+    #pragma omp parallel num_threads(threads)
+    {
+        lhsPack.resize(std::max(lhsPack.size(), MC * KC));
+        Val edge[16 * 16];
+        for (size_t jc = 0; (jc < n); jc += NC) {
+            const size_t nc = std::min(NC, n - jc);
+            for (size_t pc = 0; (pc < k); pc += KC) {
+                const size_t kc = std::min(KC, k - pc);
+                // The implicit barriers after the loops ensure that
+                // the rhs block is packed before it is used, and used
+                // before it is packed again.
+                #pragma omp for schedule(static)
+                for (size_t jr = 0; (jr < nc); jr += NR) {
+                    const size_t col = jc + jr;
+                    packRhs(transRhs ? rhs + col * ldr + pc :
+                            rhs + pc * ldr + col, ldr, transRhs, kc,
+                            std::min(NR, nc - jr), NR, rhsBlock + jr * kc);
+                }
+                #pragma omp for schedule(dynamic)
+                for (size_t ic = 0; (ic < m); ic += mcMax) {
+                    const size_t mc = std::min(mcMax, m - ic);
+                    packLhs(transLhs ? lhs + pc * ldl + ic :
+                            lhs + ic * ldl + pc, ldl, transLhs, mc, kc, MR,
+                            lhsPack.data());
+                    for (size_t jr = 0; (jr < nc); jr += NR) {
+                        const size_t nr = std::min(NR, nc - jr);
+                        for (size_t ir = 0; (ir < mc); ir += MR) {
+                            const size_t mr = std::min(MR, mc - ir);
+                            const Val* lhsPanel = &lhsPack[ir * kc];
+                            const Val* rhsPanel = rhsBlock + jr * kc;
+                            Val* tile = res + (ic + ir) * ldres + jc + jr;
+                            if ((mr == MR) && (nr == NR)) {
+                                kern.tile(kc, lhsPanel, rhsPanel, tile,
+                                          ldres);
+                                continue;
+                            }
+                            // Compute a partial tile at the edges of
+                            // the result into a buffer and add the
+                            // valid part.
+                            std::fill_n(edge, MR * NR, 0);
+                            kern.tile(kc, lhsPanel, rhsPanel, edge, NR);
+                            for (size_t i = 0; (i < mr); i++) {
+                                for (size_t j = 0; (j < nr); j++) {
+                                    tile[i * ldres + j] += edge[i * NR + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
         }
     }
-    return ret;
 }
 
 // method to do dot product of matrix
 Matrix Matrix::dot(const Matrix& rhs) const {
+    Matrix ret;
+    dotInto(rhs, ret);
+    return ret;
+}
+
+void Matrix::dotInto(const Matrix& rhs, Matrix& ret) const {
+    multiply(*this, false, rhs, false, ret);
+}
+
+// dot product with the transpose of rhs
+Matrix Matrix::dotTransB(const Matrix& rhs) const {
+    Matrix ret;
+    dotTransBInto(rhs, ret);
+    return ret;
+}
+
+void Matrix::dotTransBInto(const Matrix& rhs, Matrix& ret) const {
+    multiply(*this, false, rhs, true, ret);
+}
+
+// dot product of the transpose of this matrix with rhs
+Matrix Matrix::dotTransA(const Matrix& rhs) const {
+    Matrix ret;
+    dotTransAInto(rhs, ret);
+    return ret;
+}
+
+void Matrix::dotTransAInto(const Matrix& rhs, Matrix& ret) const {
+    multiply(*this, true, rhs, false, ret);
+}
+
+void Matrix::multiply(const Matrix& lhs, const bool transLhs,
+                      const Matrix& rhs, const bool transRhs, Matrix& ret) {
+    // the product is m x n, and each value is a sum of k products
+    const size_t m = transLhs ? lhs.numCols : lhs.numRows;
+    const size_t k = transLhs ? lhs.numRows : lhs.numCols;
+    const size_t n = transRhs ? rhs.numRows : rhs.numCols;
     // if matrix dimensions aren't correct, throw exception
-    if (rhs.height() != this->width()) {
+    if (k != (transRhs ? rhs.numCols : rhs.numRows) || &ret == &lhs ||
+        &ret == &rhs) {
         throw std::exception();
     }
-    // create matrix
-    Matrix ret(this->height(), rhs.width());
-    for (int i = 0; i < this->height(); i++) {
-        for (int j = 0; j < rhs.width(); j++) {
-            for (int k = 0; k < rhs.height(); k++) {
-                // apply dot product at each location
-                ret[i][j] = ret[i][j] + ((*this)[i][k] * rhs[k][j]);
+    // reuse the result matrix if it has the right size; the products
+    // are added to it, so it is cleared
+    if (ret.numRows != m || ret.numCols != n) {
+        ret = Matrix(m, n);
+    } else {
+        std::fill(ret.values.begin(), ret.values.end(), 0);
+    }
+    const Kernels& kern = *kernels();
+    if (m >= kern.mr && n >= kern.nr && k > 1 && m * n * k >= MinGemmOps) {
+        gemm(m, n, k, lhs.data(), lhs.rowStride, transLhs, rhs.data(),
+             rhs.rowStride, transRhs, ret.data(), ret.rowStride);
+        return;
+    }
+    if (transRhs) {
+        // the values are dot products of rows of lhs and rows of rhs,
+        // which are both contiguous
+        #pragma omp parallel for schedule(static) \
+            num_threads(threadsFor(m * n * k, ParallelOps))
+        for (size_t i = 0; i < m; i++) {
+            Val* retRow = ret[i].data();
+            if (k == 1) {
+                // an outer product of two column vectors (stored
+                // contiguously): each row is rhs scaled
+                kern.scale(rhs.data(), lhs[i][0], retRow, n);
+                continue;
+            }
+            for (size_t j = 0; j < n; j++) {
+                retRow[j] = kern.dot(lhs[i].data(), rhs[j].data(), k);
             }
         }
+        return;
+    }
+    if (transLhs && n == 1) {
+        // rhs and the result are column vectors (stored contiguously):
+        // add each row of lhs, scaled by a value of rhs, to the result.
+        // Each thread works on a slice of the result.
+        const int threads = threadsFor(m * k, ParallelVals);
+        const size_t chunk = ((m + threads - 1) / threads + 7) / 8 * 8;
+        #pragma omp parallel for schedule(static) num_threads(threads)
+        for (int t = 0; t < threads; t++) {
+            const size_t start = std::min(m, t * chunk);
+            const size_t count = std::min(chunk, m - start);
+            for (size_t p = 0; p < k && count > 0; p++) {
+                kern.axpy(rhs[p][0], lhs[p].data() + start,
+                          ret.data() + start, count);
+            }
+        }
+        return;
+    }
+    if (!transLhs && n == 1) {
+        // rhs is a column vector (stored contiguously), so each value
+        // is the dot product of a row with it.
+        #pragma omp parallel for schedule(static) \
+            num_threads(threadsFor(m * k, ParallelVals))
+        for (size_t i = 0; i < m; i++) {
+            ret[i][0] = kern.dot(lhs[i].data(), rhs.data(), k);
+        }
+        return;
+    }
+    #pragma omp parallel for schedule(static) \
+        num_threads(threadsFor(m * n * k, ParallelOps))
+    for (size_t i = 0; i < m; i++) {
+        Val* retRow = ret[i].data();
+        // add each row of rhs, scaled, to the result row so that all
+        // the loops walk contiguous values
+        for (size_t p = 0; p < k; p++) {
+            const Val scale = transLhs ? lhs[p][i] : lhs[i][p];
+            kern.axpy(scale, rhs[p].data(), retRow, n);
+        }
+    }
+}
+
+// The most values in a block that transposeBlock() copies without
+// splitting it: the block and its transpose (16 KB) fit in the L1
+// cache.
+constexpr size_t TransposeLeafVals = 32 * 32;
+
+/**
+ * Writes the transpose of the rows x cols block at src, whose rows are
+ * lds values apart, to dest, whose rows are ldd values apart.  The
+ * longer side of the block is halved until it fits in the L1 cache,
+ * so that each level of the cache holds the parts being worked on
+ * whatever its size (a cache-oblivious transpose).  Such a block is
+ * copied with the block transpose kernel, which reads and writes
+ * whole rows of tb values; the values left over at the right and
+ * bottom edges are copied one at a time.
+ */
+static void transposeBlock(const Kernels& kern, const Val* src,
+                           const size_t lds, Val* dest, const size_t ldd,
+                           const size_t rows, const size_t cols) {
+    const size_t tb = kern.tb;
+    if (rows * cols > TransposeLeafVals) {
+        // Split at a multiple of tb, so that only the blocks at the
+        // edges of the matrix have left over values.
+        if (rows >= cols) {
+            const size_t half = (rows / 2 + tb - 1) / tb * tb;
+            transposeBlock(kern, src, lds, dest, ldd, half, cols);
+            transposeBlock(kern, src + half * lds, lds, dest + half, ldd,
+                           rows - half, cols);
+        } else {
+            const size_t half = (cols / 2 + tb - 1) / tb * tb;
+            transposeBlock(kern, src, lds, dest, ldd, rows, half);
+            transposeBlock(kern, src + half, lds, dest + half * ldd, ldd,
+                           rows, cols - half);
+        }
+        return;
+    }
+    const size_t fullRows = rows / tb * tb, fullCols = cols / tb * tb;
+    for (size_t i = 0; i < fullRows; i += tb) {
+        for (size_t j = 0; j < fullCols; j += tb) {
+            kern.transpose(src + i * lds + j, lds, dest + j * ldd + i, ldd);
+        }
+        for (size_t r = i; r < i + tb; r++) {
+            for (size_t j = fullCols; j < cols; j++) {
+                dest[j * ldd + r] = src[r * lds + j];
+            }
+        }
+    }
+    for (size_t r = fullRows; r < rows; r++) {
+        for (size_t j = 0; j < cols; j++) {
+            dest[j * ldd + r] = src[r * lds + j];
+        }
     }
-    return ret;
 }
 
 // transpose matrix
 Matrix Matrix::transpose() const {
-    // create return matrix
-    Matrix ret(this->width(), this->height());
-    for (int i = 0; i < this->width(); i++) {
-        for (int j = 0; j < this->height(); j++) {
-            // switch matrix values at each location
-            ret[i][j] = (*this)[j][i];
-        }
+    // create return matrix; every value is set below
+    Matrix ret = uninitialized(numCols, numRows);
+    if (numRows == 1 || numCols == 1) {
+        // a row or column vector is stored contiguously, so its
+        // transpose has the same values in the same order
+        std::copy_n(data(), numRows * numCols, ret.data());
+        return ret;
+    }
+    // each thread fills a block of rows of ret (columns of this
+    // matrix), a multiple of tb long
+    const Kernels& kern = *kernels();
+    const int threads = threadsFor(numRows * numCols, ParallelVals);
+    const size_t blocks = (numCols + kern.tb - 1) / kern.tb;
+    #pragma omp parallel for schedule(static) num_threads(threads)
+    for (int t = 0; t < threads; t++) {
+        const size_t start = std::min(numCols, blocks * t / threads * kern.tb);
+        const size_t end = std::min(numCols,
+                                    blocks * (t + 1) / threads * kern.tb);
+        transposeBlock(kern, data() + start, rowStride,
+                       ret.data() + start * ret.rowStride, ret.rowStride,
+                       numRows, end - start);
     }
     return ret;
 }
 
+// transpose matrix in place
+void Matrix::transposeInPlace() {
+    if (numRows != numCols) {
+        // the shape changes, so a new buffer is needed anyway
+        *this = transpose();
+        return;
+    }
+    // swap each tb x tb block above the diagonal with its mirror
+    // block below it, transposing both, through a buffer that holds
+    // one of them; the blocks on the diagonal are transposed through
+    // the buffer.  The rows further down have fewer blocks to swap,
+    // so they are handed out to the threads dynamically.
+    const Kernels& kern = *kernels();
+    const size_t tb = kern.tb, n = numRows, full = n / tb * tb;
+    Val* vals = data();
+    #pragma omp parallel for schedule(dynamic) \
+        num_threads(threadsFor(n * n, ParallelVals))
+    for (size_t i = 0; i < full; i += tb) {
+        alignas(64) Val buf[8 * 8];
+        for (size_t j = i; j < full; j += tb) {
+            Val* upper = vals + i * rowStride + j;
+            Val* lower = vals + j * rowStride + i;
+            kern.transpose(upper, rowStride, buf, tb);
+            if (j != i) {
+                kern.transpose(lower, rowStride, upper, rowStride);
+            }
+            for (size_t r = 0; r < tb; r++) {
+                std::copy_n(buf + r * tb, tb, lower + r * rowStride);
+            }
+        }
+    }
+    // swap the values in the columns past the last whole block
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = std::max(full, i + 1); j < n; j++) {
+            std::swap(vals[i * rowStride + j], vals[j * rowStride + i]);
+        }
+    }
+}
+
 // Operator to write the matrix to a given output stream
 std::ostream& operator<<(std::ostream& os, const Matrix& matrix) {
     // Print the number of rows and columns to ease reading
     os << matrix.height() << " " << matrix.width() << '\n';
     // Print each entry to the output stream.
-    for (auto& row : matrix) {
-        for (auto& val : row) {
+    for (int row = 0; row < matrix.height(); row++) {
+        for (const auto& val : matrix[row]) {
             os << val << " ";
         }
         // Print a new line at the end of each row just to format the
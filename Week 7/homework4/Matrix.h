@@ -9,14 +9,85 @@
 
 #include <iostream>
 #include <functional>
+#include <new>
+#include <string>
+#include <utility>
 #include <vector>
 #include <cassert>
 
 /** Shortcut for the value of each element in the matrix */
 using Val = double;
 
-/** Short cut to a 2-d vector double values to streamline the code */
-using TwoDVec = std::vector<std::vector<Val>>;
+/** An allocator that aligns each buffer to a 64-byte cache line, so
+    that the values of a matrix can be used with aligned SIMD loads
+    and no cache line is shared with another allocation.
+*/
+template<typename T>
+struct AlignedAllocator {
+    /** The alignment (in bytes) of every buffer */
+    static constexpr size_t Alignment = 64;
+
+    using value_type = T;
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T),
+                                              std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* ptr, const size_t) {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    /** Values that are resized without an initial value are left
+        uninitialized, since they are about to be overwritten. */
+    template<typename U>
+    void construct(U* ptr) { ::new(static_cast<void*>(ptr)) U; }
+
+    template<typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        ::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+
+    bool operator==(const AlignedAllocator&) const { return true; }
+    bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+/** A lightweight view of one row of a Matrix.  It is returned by
+    Matrix::operator[] so that the values can be accessed as
+    matrix[row][col], and it works with the standard algorithms via
+    begin() and end().  T is Val or const Val.
+*/
+template<typename T>
+class MatrixRow {
+public:
+    MatrixRow(T* values, const size_t cols) : values(values), cols(cols) {}
+
+    /** Returns the value in a given column of the row. */
+    T& operator[](const size_t col) const { return values[col]; }
+
+    /** Returns the number of columns in the row. */
+    size_t size() const { return cols; }
+
+    T* begin() const { return values; }
+    T* end()   const { return values + cols; }
+    T* data()  const { return values; }
+    T& front() const { return values[0]; }
+    T& back()  const { return values[cols - 1]; }
+
+    /** Returns a copy of the values in the row. */
+    operator std::vector<Val>() const { return {begin(), end()}; }
+
+private:
+    /** The first value in the row */
+    T* values;
+    /** The number of columns in the row */
+    size_t cols;
+};
 
 /** A matrix class to perform basic matrix operations.
 
@@ -30,10 +101,20 @@ using TwoDVec = std::vector<std::vector<Val>>;
 
     <li> Stream insertion and extraction operators to conveniently
     load and print values.</li>
+
+    <li> A binary file format that is loaded without parsing (see
+    writeBinary() and readBinary()).</li>
     
     </ul>
+
+    The values are stored in one 64-byte aligned buffer, row after
+    row.  Each row starts stride() values after the previous one.
+    Rows of at least PadCols columns are padded to a multiple of 8
+    values so that every row starts on a cache line; narrower
+    matrices (such as the column vectors used by NeuralNet) are stored
+    without padding.  The padding is always zero.
 */
-class Matrix : public TwoDVec {
+class Matrix {
     /** Stream insertion operator to ease printing matrices
      *
      * This method prints the dimension of the matrix and then prints
@@ -83,19 +164,72 @@ public:
     explicit Matrix(const size_t rows = 0, const size_t cols = 0,
                     const Val initVal = 0);
 
+    /** Copies the values (and padding) of another matrix. */
+    Matrix(const Matrix&) = default;
+    Matrix& operator=(const Matrix&) = default;
+
+    /**
+     * Moves the buffer of another matrix into this one without
+     * copying the values.  The other matrix is left empty (0 x 0 with
+     * a stride of 0), so that it can be reused or assigned to.
+     */
+    Matrix(Matrix&& other) noexcept;
+    Matrix& operator=(Matrix&& other) noexcept;
+
+    /** Rows with at least these many columns are padded so that each
+        row starts on a 64-byte boundary. */
+    static constexpr size_t PadCols = 64;
+
+    /** The least number of values apply() gives each thread.  It is
+        lower than for the other operations, as the unary operations
+        (such as a sigmoid) cost more than an add. */
+    static constexpr size_t ParallelApplyVals = 1 << 12;
+
     /**
      * Returns the height or number of rows in this matrix.
      *
      * \return Returns the height or number of rows in this matrix.
      */
-    int height() const { return size(); }
+    int height() const { return numRows; }
 
     /**
      * Returns the width or number of columns in this matrix.
      *
      * \return Returns the width or number of columns in this matrix.
      */
-    int width() const { return (height() > 0) ? front().size() : 0; }
+    int width() const { return numCols; }
+
+    /**
+     * Returns the number of values from the start of one row to the
+     * start of the next.  This is at least width().
+     */
+    size_t stride() const { return rowStride; }
+
+    /**
+     * Returns true if this matrix has no rows.
+     */
+    bool empty() const { return numRows == 0; }
+
+    /**
+     * Returns the buffer of values.  Row r starts at data() + r *
+     * stride().
+     */
+    Val* data() { return values.data(); }
+    const Val* data() const { return values.data(); }
+
+    /**
+     * Returns a view of a given row, so that values can be accessed
+     * as matrix[row][col].
+     *
+     * \param[in] row The index of the row.  It is not checked.
+     */
+    MatrixRow<Val> operator[](const size_t row) {
+        return {values.data() + row * rowStride, numCols};
+    }
+
+    MatrixRow<const Val> operator[](const size_t row) const {
+        return {values.data() + row * rowStride, numCols};
+    }
     
     /**
      * Creates a new matrix in which each value is obtained by
@@ -105,18 +239,50 @@ public:
      * the given matrix.
      */
     template<typename UnaryOp>
-    Matrix apply(const UnaryOp& operation) const {
+    Matrix apply(const UnaryOp& operation) const& {
         // Note that the unary operation can be applied as:
         // val = operation(val);
-        Matrix ret(this->height(), this->width(), 0);
-        for (int i = 0; i < this->height(); i++) {
-            for (int j = 0; j < this->width(); j++) {
-                ret[i][j] = operation((*this)[i][j]);
+        // The rows are split between threads for large matrices.
+        Matrix ret = uninitialized(numRows, numCols);
+        #pragma omp parallel for schedule(static) \
+            num_threads(threadsFor(numRows * numCols, ParallelApplyVals))
+        for (size_t i = 0; i < numRows; i++) {
+            const Val* src = (*this)[i].data();
+            Val* dest = ret[i].data();
+            for (size_t j = 0; j < numCols; j++) {
+                dest[j] = operation(src[j]);
             }
         }
         return ret;
     }
 
+    /** Overload for temporary matrices, whose values are replaced in
+        place instead of being copied. */
+    template<typename UnaryOp>
+    Matrix apply(const UnaryOp& operation) && {
+        return std::move(applyInPlace(operation));
+    }
+
+    /**
+     * Replaces each value in this matrix with the value obtained by
+     * applying a given unary operator to it.
+     *
+     * \param[in] operation The unary operation to be applied.
+     *
+     * \return This matrix.
+     */
+    template<typename UnaryOp>
+    Matrix& applyInPlace(const UnaryOp& operation) {
+        #pragma omp parallel for schedule(static) \
+            num_threads(threadsFor(numRows * numCols, ParallelApplyVals))
+        for (size_t i = 0; i < numRows; i++) {
+            for (Val& val : (*this)[i]) {
+                val = operation(val);
+            }
+        }
+        return *this;
+    }
+
     /**
      * Operator to add two matrices with the same dimensions together.
      *
@@ -128,7 +294,11 @@ public:
      * computed by adding the corresponding values from \c this and
      * rhs.
      */
-    Matrix operator+(const Matrix& rhs) const;
+    Matrix operator+(const Matrix& rhs) const&;
+
+    /** Overload for a temporary lhs (e.g., std::move(a) + b or the
+        a + b in a + b + c), whose buffer is reused for the result. */
+    Matrix operator+(const Matrix& rhs) &&;
 
     /**
      * Operator for computing the Hadamard product of two matrices
@@ -142,7 +312,8 @@ public:
      * computed by multiplying the corresponding values from \c this
      * and rhs.
      */
-    Matrix operator*(const Matrix& rhs) const;
+    Matrix operator*(const Matrix& rhs) const&;
+    Matrix operator*(const Matrix& rhs) &&;
 
     /**
      * Operator for computing the Hadamard product of two matrices
@@ -156,7 +327,8 @@ public:
      * computed by multiplying the corresponding values from \c this
      * and rhs.
      */
-    Matrix operator*(const Val val) const;
+    Matrix operator*(const Val val) const&;
+    Matrix operator*(const Val val) &&;
     
     /**
      * Operator to subtract two matrices with the same dimensions.
@@ -169,11 +341,30 @@ public:
      * computed by subtracting the corresponding values from \c this
      * and rhs.
      */
-    Matrix operator-(const Matrix& rhs) const;
+    Matrix operator-(const Matrix& rhs) const&;
+    Matrix operator-(const Matrix& rhs) &&;
+
+    /**
+     * Adds another matrix with the same dimensions to this matrix, in
+     * place.  The other in-place operators below are similar.  They
+     * throw an exception if the dimensions differ.
+     *
+     * \return This matrix.
+     */
+    Matrix& operator+=(const Matrix& rhs);
+    Matrix& operator-=(const Matrix& rhs);
+
+    /** Hadamard product in place */
+    Matrix& operator*=(const Matrix& rhs);
+
+    /** Multiplies each value in this matrix by a given value. */
+    Matrix& operator*=(const Val val);
     
     /**
      * Performs the dot product of two matrices. This method has a
-     * O(n^3) time complexity.
+     * O(n^3) time complexity.  Large products are computed with
+     * cache-blocked, packed panels and a register-tiled kernel (see
+     * gemm() in Matrix.cpp); small ones with a row-by-row loop.
      *
      * \param[in] rhs The other matrix to be used.  This matrix must
      * have the same number of rows as the number of columns in this
@@ -186,9 +377,183 @@ public:
     Matrix dot(const Matrix& rhs) const;
 
     /**
-     * Returns the transpose of this matrix.
+     * Computes the dot product of this matrix and rhs into a given
+     * matrix, reusing its buffer if it already has the dimensions of
+     * the result, so that repeated products do not allocate memory.
+     *
+     * \param[in] rhs The other matrix to be used, as in dot().
+     *
+     * \param[out] result The matrix to hold the product.  It must not
+     * be this matrix or rhs.
+     */
+    void dotInto(const Matrix& rhs, Matrix& result) const;
+
+    /**
+     * Performs the dot product of this matrix and the transpose of
+     * rhs, i.e., this . rhs^T, without creating the transpose: each
+     * value is the dot product of a row of this matrix and a row of
+     * rhs.
+     *
+     * \param[in] rhs The other matrix to be used.  It must have the
+     * same number of columns as this matrix.  Otherwise this method
+     * throws an exception.
+     */
+    Matrix dotTransB(const Matrix& rhs) const;
+
+    /** Same as dotTransB(), into a given matrix as in dotInto(). */
+    void dotTransBInto(const Matrix& rhs, Matrix& result) const;
+
+    /**
+     * Performs the dot product of the transpose of this matrix and
+     * rhs, i.e., this^T . rhs, without creating the transpose: the
+     * rows of rhs are scaled by the columns of this matrix.
+     *
+     * \param[in] rhs The other matrix to be used.  It must have the
+     * same number of rows as this matrix.  Otherwise this method
+     * throws an exception.
+     */
+    Matrix dotTransA(const Matrix& rhs) const;
+
+    /** Same as dotTransA(), into a given matrix as in dotInto(). */
+    void dotTransAInto(const Matrix& rhs, Matrix& result) const;
+
+    /**
+     * Returns the transpose of this matrix.  It is copied in blocks
+     * that fit in the L1 cache, each of which is transposed a few
+     * rows at a time in SIMD registers.
      */
     Matrix transpose() const;
+
+    /**
+     * Transposes this matrix.  A square matrix is transposed in its
+     * own buffer, by swapping blocks across the diagonal; any other
+     * matrix is replaced by transpose().
+     */
+    void transposeInPlace();
+
+    /**
+     * Writes this matrix to a file in the binary format read by
+     * readBinary(): a 64-byte header followed by the values as they
+     * are stored in memory, row after row, including the padding.
+     * The header is (offsets and sizes in bytes):
+     *
+     *    0  8  The magic "MATRXBIN"
+     *    8  4  The version of the format (1)
+     *   12  4  0x01020304 as written by the writer, which reads
+     *          0x04030201 on a machine with the other byte order
+     *   16  4  The type of the values (1: 64-bit IEEE doubles)
+     *   24  8  The number of rows
+     *   32  8  The number of columns
+     *   40  8  The number of values from one row to the next
+     *   48  8  The offset of the first value in the file (64)
+     *
+     * The other bytes are zero.  Every field and value is in the byte
+     * order of the writer.
+     *
+     * \param[in] path The file to be written.  If it cannot be
+     * written, this method throws a std::runtime_error.
+     */
+    void writeBinary(const std::string& path) const;
+
+    /**
+     * Loads a matrix from a file written by writeBinary().  The file
+     * is mapped into memory and its rows are copied straight into the
+     * new matrix, without parsing them.
+     *
+     * \param[in] path The file to be read.  If it cannot be read, or
+     * it is not a binary matrix of doubles written on a machine with
+     * the same byte order, this method throws a std::runtime_error.
+     *
+     * \return The matrix read from the file.
+     */
+    static Matrix readBinary(const std::string& path);
+
+    /**
+     * Returns true if a file is taken to be in the binary format of
+     * writeBinary(), i.e., its name ends with .bin.  The tester and
+     * the converter pick the format of each file this way.
+     *
+     * \param[in] path The name of the file.
+     */
+    static bool isBinaryFile(const std::string& path);
+
+    /**
+     * Returns the name of the SIMD kernels used by the element-wise
+     * operators and dot(): "avx512", "avx2", or "scalar".  The best
+     * kernels the CPU supports are picked when they are first used,
+     * unless the MATRIX_SIMD environment variable names others.
+     */
+    static std::string simd();
+
+    /**
+     * Selects the SIMD kernels to be used.  This is meant for testing
+     * and benchmarking, and must not be called while other threads
+     * are using matrices.
+     *
+     * \param[in] isa "avx512", "avx2", or "scalar".
+     *
+     * \return False (and the kernels are unchanged) if the kernels
+     * are unknown or not supported by this CPU.
+     */
+    static bool setSimd(const std::string& isa);
+
+    /**
+     * Returns the number of threads used by the operations on large
+     * matrices: the count given to setThreads(), or else the
+     * MATRIX_THREADS environment variable, or else the OpenMP default
+     * (OMP_NUM_THREADS or the number of cores).  It is 1 unless the
+     * program is compiled with -fopenmp.
+     */
+    static int threads();
+
+    /**
+     * Sets the number of threads used by the operations on large
+     * matrices.  Like setSimd(), this must not be called while other
+     * threads are using matrices.
+     *
+     * \param[in] count The number of threads.  Zero restores the
+     * default.
+     */
+    static void setThreads(const int count);
+
+    /**
+     * Returns the number of threads to be used for an operation that
+     * does a given amount of work: at most threads(), but few enough
+     * that each gets at least minWork.  Operations on small matrices
+     * thus stay on the calling thread.
+     */
+    static int threadsFor(const size_t work, const size_t minWork);
+
+private:
+    /**
+     * Creates a matrix whose values are left uninitialized (the
+     * padding is zero), for results that overwrite every value.
+     */
+    static Matrix uninitialized(const size_t rows, const size_t cols);
+
+    /**
+     * Applies an element-wise kernel (see ElemOp in Matrix.cpp) to
+     * lhs and rhs, storing the values in result, which must have the
+     * same dimensions and may be lhs.
+     */
+    static void elementwise(const Matrix& lhs, const Matrix& rhs,
+                            const int op, Matrix& result);
+
+    /**
+     * Computes the product of lhs (or its transpose, if transLhs is
+     * true) and rhs (or its transpose) into result, which must not be
+     * lhs or rhs.  This does the work of dotInto() and its variants.
+     */
+    static void multiply(const Matrix& lhs, const bool transLhs,
+                         const Matrix& rhs, const bool transRhs,
+                         Matrix& result);
+
+    /** The number of rows and columns in this matrix */
+    size_t numRows = 0, numCols = 0;
+    /** The number of values from the start of one row to the next */
+    size_t rowStride = 0;
+    /** The values, row after row, including any padding */
+    std::vector<Val, AlignedAllocator<Val>> values;
 };
 
 #endif
@@ -0,0 +1,301 @@
+/**
+ * A simple benchmark for the Matrix class.  It times the matrix
+ * operations on square matrices of the given sizes and counts the
+ * heap allocations each one makes, by replacing the global operator
+ * new.
+ *
+ * Copyright (C) John Doll
+ *
+ * Compile and run with:
+ *   $ g++ -std=c++17 -O3 -march=native -fopenmp -o bench bench.cpp \
+ *         Matrix.cpp
+ *   $ MATRIX_THREADS=8 ./bench dot 256 512 1024
+ *   $ ./bench transpose 784x1 60000x784 1024
+ *
+ * The benchmarks are:
+ *   load N ...     Create an NxN matrix (allocations only).
+ *   dot N ...      Multiply two NxN matrices (GFLOP/s).
+ *   kernels N ...  Run each operation with each SIMD kernel the CPU
+ *                  supports (GFLOP/s and GB/s).  The GB/s of dot
+ *                  counts each matrix once.
+ *   inplace N ...  Run the in-place operations in a loop next to the
+ *                  operators that return a new matrix, and the
+ *                  transposed products next to transpose() and dot()
+ *                  (milliseconds and allocations per run).
+ *   transpose RxC ...  Transpose an RxC matrix, or an NxN one if
+ *                  only N is given, next to copying it (GB/s, counting
+ *                  the values read and written).  A square matrix is
+ *                  also transposed in place.
+ *   io N ...       Load an NxN matrix from a text file (operator>>)
+ *                  and from a binary file (Matrix::readBinary()), both
+ *                  written to the current directory and removed
+ *                  afterwards (milliseconds and MB/s of values).
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "Matrix.h"
+
+/** The number of calls to operator new since the program started */
+static long allocCount = 0;
+
+/** Where the copy benchmark stores the copy, so that the compiler does
+    not drop it */
+static const Val* volatile copySink = nullptr;
+
+void* operator new(const size_t size) {
+    allocCount++;
+    if (void* ptr = std::malloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(const size_t size, const std::align_val_t align) {
+    allocCount++;
+    const size_t alignment = static_cast<size_t>(align);
+    if (void* ptr = std::aligned_alloc(alignment, (size + alignment - 1) /
+                                       alignment * alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+/**
+ * Returns a matrix of random values in the range -1 to 1.
+ */
+Matrix randomMatrix(const int rows, const int cols, const unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<Val> dist(-1, 1);
+    Matrix mat(rows, cols);
+    for (int i = 0; (i < rows); i++) {
+        for (int j = 0; (j < cols); j++) {
+            mat[i][j] = dist(rng);
+        }
+    }
+    return mat;
+}
+
+/**
+ * Runs an operation repeatedly for at least 0.2 seconds and returns
+ * the best time of one run, in seconds.  The allocations made by
+ * one run are stored in allocs.
+ */
+template<typename Op>
+double timeOp(const Op& op, long& allocs) {
+    using Clock = std::chrono::steady_clock;
+    double best = 1e30, total = 0;
+    for (int run = 0; (run < 3) || (total < 0.2); run++) {
+        const long before = allocCount;
+        const auto start = Clock::now();
+        op();
+        const std::chrono::duration<double> time = Clock::now() - start;
+        allocs = allocCount - before;
+        best = std::min(best, time.count());
+        total += time.count();
+    }
+    return best;
+}
+
+/**
+ * Times each element-wise operation and dot with each SIMD kernel the
+ * CPU supports, on NxN matrices.
+ */
+void kernelBench(const int n) {
+    const Matrix lhs = randomMatrix(n, n, 1);
+    const Matrix rhs = randomMatrix(n, n, 2);
+    const double vals = double(n) * n;
+    long allocs = 0;
+    for (const std::string isa : {"scalar", "avx2", "avx512"}) {
+        if (!Matrix::setSimd(isa)) {
+            continue;
+        }
+        // The flops and bytes moved by each operation.
+        const struct {
+            const char* name;
+            std::function<void()> op;
+            double flops, bytes;
+        } ops[] = {
+            {"+", [&] { lhs + rhs; }, vals, 24 * vals},
+            {"-", [&] { lhs - rhs; }, vals, 24 * vals},
+            {"*", [&] { lhs * rhs; }, vals, 24 * vals},
+            {"*val", [&] { lhs * 1.5; }, vals, 16 * vals},
+            {"dot", [&] { lhs.dot(rhs); }, 2 * vals * n, 24 * vals},
+        };
+        for (const auto& op : ops) {
+            const double secs = timeOp(op.op, allocs);
+            std::cout << isa << ' ' << op.name << ' ' << n << "x" << n
+                      << ": " << (op.flops / secs / 1e9) << " GFLOP/s, "
+                      << (op.bytes / secs / 1e9) << " GB/s\n";
+        }
+    }
+}
+
+/**
+ * Times the in-place operations on NxN matrices, run repeatedly on
+ * the same matrices, and the operators that return a new matrix.
+ * The allocations are those of the last run, i.e., in the steady
+ * state.
+ */
+void inplaceBench(const int n) {
+    const Matrix lhs = randomMatrix(n, n, 1);
+    const Matrix rhs = randomMatrix(n, n, 2);
+    const Matrix ones(n, n, 1);
+    Matrix res = randomMatrix(n, n, 3), prod;
+    // An operation that neither grows nor shrinks the values
+    const auto negate = [](const Val val) { return -val; };
+    long allocs = 0;
+    const struct {
+        const char* name;
+        std::function<void()> op;
+    } ops[] = {
+        {"a + b", [&] { lhs + rhs; }},
+        {"c += b", [&] { res += rhs; }},
+        {"c = std::move(c) + b", [&] { res = std::move(res) + rhs; }},
+        {"c = b + std::move(c)", [&] { res = rhs + std::move(res); }},
+        {"a - b", [&] { lhs - rhs; }},
+        {"c -= b", [&] { res -= rhs; }},
+        {"a * b", [&] { lhs * ones; }},
+        {"c *= b", [&] { res *= ones; }},
+        {"a * val", [&] { lhs * -1.0; }},
+        {"c *= val", [&] { res *= -1.0; }},
+        {"a.apply(f)", [&] { lhs.apply(negate); }},
+        {"c.applyInPlace(f)", [&] { res.applyInPlace(negate); }},
+        {"a.dot(b)", [&] { lhs.dot(rhs); }},
+        {"a.dotInto(b, c)", [&] { lhs.dotInto(rhs, prod); }},
+        {"a.dot(b.transpose())", [&] { lhs.dot(rhs.transpose()); }},
+        {"a.dotTransB(b)", [&] { lhs.dotTransB(rhs); }},
+        {"a.transpose().dot(b)", [&] { lhs.transpose().dot(rhs); }},
+        {"a.dotTransA(b)", [&] { lhs.dotTransA(rhs); }},
+    };
+    for (const auto& op : ops) {
+        const double secs = timeOp(op.op, allocs);
+        std::cout << op.name << ' ' << n << "x" << n << ": "
+                  << (secs * 1e3) << " ms, " << allocs << " allocations\n";
+    }
+}
+
+/**
+ * Times transpose() on a rows x cols matrix, and a copy of it for
+ * comparison.  A square matrix is also transposed in place, which
+ * needs no new buffer.
+ */
+void transposeBench(const int rows, const int cols) {
+    Matrix mat = randomMatrix(rows, cols, 1);
+    const double bytes = 16.0 * rows * cols;
+    long allocs = 0;
+    const struct {
+        const char* name;
+        std::function<void()> op;
+    } ops[] = {
+        {"copy", [&] {
+            Matrix copy = mat;
+            copySink = copy.data();
+        }},
+        {"transpose", [&] { mat.transpose(); }},
+        {"transposeInPlace", [&] { mat.transposeInPlace(); }},
+    };
+    for (const auto& op : ops) {
+        if ((rows != cols) && (op.name == std::string("transposeInPlace"))) {
+            continue;
+        }
+        const double secs = timeOp(op.op, allocs);
+        std::cout << op.name << ' ' << rows << "x" << cols << ": "
+                  << (secs * 1e6) << " us, " << (bytes / secs / 1e9)
+                  << " GB/s\n";
+    }
+}
+
+/**
+ * Times loading an NxN matrix of random values from a text file and
+ * from a binary file.  The text has all the digits needed to give the
+ * same values.
+ */
+void ioBench(const int n) {
+    const Matrix mat = randomMatrix(n, n, 1);
+    const std::string text = "bench_io.txt", binary = "bench_io.bin";
+    {
+        std::ofstream os(text);
+        os << std::setprecision(17) << mat;
+    }
+    mat.writeBinary(binary);
+    const double bytes = 8.0 * n * n;
+    long allocs = 0;
+    const struct {
+        const char* name;
+        std::function<void()> op;
+    } ops[] = {
+        {"text", [&] {
+            std::ifstream is(text);
+            Matrix loaded;
+            is >> loaded;
+        }},
+        {"binary", [&] { Matrix::readBinary(binary); }},
+    };
+    for (const auto& op : ops) {
+        const double secs = timeOp(op.op, allocs);
+        std::cout << "load " << op.name << ' ' << n << "x" << n << ": "
+                  << (secs * 1e3) << " ms, " << (bytes / secs / 1e6)
+                  << " MB/s\n";
+    }
+    std::remove(text.c_str());
+    std::remove(binary.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: bench <load|dot|kernels|inplace|transpose|io> "
+                  << "<N> [N ...]\n";
+        return 1;
+    }
+    const std::string bench = argv[1];
+    for (int arg = 2; (arg < argc); arg++) {
+        const int n = std::stoi(argv[arg]);
+        long allocs = 0;
+        if (bench == "load") {
+            timeOp([&] { Matrix mat(n, n); }, allocs);
+            std::cout << "load " << n << "x" << n << ": " << allocs
+                      << " allocations\n";
+        } else if (bench == "dot") {
+            const Matrix lhs = randomMatrix(n, n, 1);
+            const Matrix rhs = randomMatrix(n, n, 2);
+            const double secs = timeOp([&] { lhs.dot(rhs); }, allocs);
+            std::cout << "dot " << n << "x" << n << ": "
+                      << (2.0 * n * n * n / secs / 1e9) << " GFLOP/s, "
+                      << allocs << " allocations\n";
+        } else if (bench == "kernels") {
+            kernelBench(n);
+        } else if (bench == "inplace") {
+            inplaceBench(n);
+        } else if (bench == "transpose") {
+            const std::string shape = argv[arg];
+            const size_t x = shape.find('x');
+            transposeBench(n, (x == std::string::npos) ? n :
+                           std::stoi(shape.substr(x + 1)));
+        } else if (bench == "io") {
+            ioBench(n);
+        } else {
+            std::cout << "Invalid benchmark " << bench << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
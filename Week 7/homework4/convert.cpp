@@ -0,0 +1,73 @@
+/**
+ * Converts a matrix between the text format of operator>> and
+ * operator<< and the binary format of Matrix::writeBinary(), which
+ * the tester (main.cpp) and Matrix::readBinary() load without
+ * parsing.  The format of each file is picked by its extension:
+ * .bin files are binary, and all others are text.  The text is
+ * written with enough digits that converting it back gives the same
+ * values.
+ *
+ * Copyright (C) John Doll
+ *
+ * Compile and run with:
+ *   $ g++ -std=c++17 -O3 -march=native -fopenmp -o convert \
+ *         convert.cpp Matrix.cpp
+ *   $ ./convert mat70x50.txt mat70x50.bin
+ *   $ ./convert mat70x50.bin mat70x50.txt
+ */
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include "Matrix.h"
+
+/**
+ * Reads a matrix from a text or binary file.
+ */
+Matrix read(const std::string& path) {
+    if (Matrix::isBinaryFile(path)) {
+        return Matrix::readBinary(path);
+    }
+    std::ifstream is(path);
+    if (!is) {
+        throw std::runtime_error("Error opening file " + path);
+    }
+    Matrix mat;
+    if (!(is >> mat)) {
+        throw std::runtime_error("Error reading file " + path);
+    }
+    return mat;
+}
+
+/**
+ * Writes a matrix to a text or binary file.
+ */
+void write(const Matrix& mat, const std::string& path) {
+    if (Matrix::isBinaryFile(path)) {
+        mat.writeBinary(path);
+        return;
+    }
+    std::ofstream os(path);
+    os << std::setprecision(std::numeric_limits<Val>::max_digits10) << mat;
+    if (!os) {
+        throw std::runtime_error("Error writing file " + path);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cout << "Usage: convert <input> <output>\n"
+                  << "Files ending with .bin are binary, others are text.\n";
+        return 1;
+    }
+    try {
+        write(read(argv[1]), argv[2]);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+    return 0;
+}
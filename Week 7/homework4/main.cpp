@@ -41,12 +41,17 @@ double invSigmoid(const double val) {
 /**
  * Helper method to load matrix data from a given file. This method
  * essentially tests the operator>> (stream extraction operator) for
- * the matrix class.
+ * the matrix class.  Files with the .bin extension are instead read
+ * with Matrix::readBinary() (see the convert program).
  *
  * \param[in] file The file from where the data is to be loaded.  If
  * the file cannot be opened, then this method throws an exception.
  */
 Matrix load(const std::string& path) {
+    // Binary files are mapped into memory rather than parsed.
+    if (Matrix::isBinaryFile(path)) {
+        return Matrix::readBinary(path);
+    }
     // Open the specified file.
     std::ifstream matFile(path);
     // Check to ensure that the file is ok
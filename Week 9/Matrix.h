@@ -10,14 +10,102 @@
 
 #include <iostream>
 #include <functional>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <cassert>
 
 /** Shortcut for the value of each element in the matrix */
 using Val = double;
 
-/** Short cut to a 2-d vector double values to streamline the code */
-using TwoDVec = std::vector<std::vector<Val>>;
+/** An allocator that aligns each buffer to a 64-byte cache line, so
+    that the values of a matrix can be used with aligned SIMD loads
+    and no cache line is shared with another allocation.
+*/
+template<typename T>
+struct AlignedAllocator {
+    /** The alignment (in bytes) of every buffer */
+    static constexpr size_t Alignment = 64;
+
+    using value_type = T;
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(const size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T),
+                                              std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* ptr, const size_t) {
+        ::operator delete(ptr, std::align_val_t(Alignment));
+    }
+
+    /** Values that are resized without an initial value are left
+        uninitialized, since they are about to be overwritten. */
+    template<typename U>
+    void construct(U* ptr) { ::new(static_cast<void*>(ptr)) U; }
+
+    template<typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        ::new(static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+    }
+
+    bool operator==(const AlignedAllocator&) const { return true; }
+    bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+/** A lightweight view of one row of a Matrix.  It is returned by
+    Matrix::operator[] so that the values can be accessed as
+    matrix[row][col], and it works with the standard algorithms via
+    begin() and end().  T is Val or const Val.
+*/
+template<typename T>
+class MatrixRow {
+public:
+    MatrixRow(T* values, const size_t cols) : values(values), cols(cols) {}
+
+    /** Returns the value in a given column of the row. */
+    T& operator[](const size_t col) const { return values[col]; }
+
+    /** Returns the number of columns in the row. */
+    size_t size() const { return cols; }
+
+    T* begin() const { return values; }
+    T* end()   const { return values + cols; }
+    T* data()  const { return values; }
+    T& front() const { return values[0]; }
+    T& back()  const { return values[cols - 1]; }
+
+    /** Returns a copy of the values in the row. */
+    operator std::vector<Val>() const { return {begin(), end()}; }
+
+private:
+    /** The first value in the row */
+    T* values;
+    /** The number of columns in the row */
+    size_t cols;
+};
+
+template<typename Derived>
+class MatrixExpr;
+
+/** True if T is a lazy element-wise expression (see MatrixExpr) */
+template<typename T>
+constexpr bool IsMatrixExpr = std::is_base_of<MatrixExpr<T>, T>::value;
+
+class Matrix;
+
+/** True if T is a Matrix or an expression, i.e., it can be used with
+    the element-wise operators. */
+template<typename T>
+constexpr bool IsMatrixOperand =
+    std::is_same<std::decay_t<T>, Matrix>::value ||
+    IsMatrixExpr<std::decay_t<T>>;
 
 /** A matrix class to perform basic matrix operations.
 
@@ -29,12 +117,23 @@ using TwoDVec = std::vector<std::vector<Val>>;
 
     <li>Matrix multiplication using Block matrix multiplication.</li>
 
+    <li>Element-wise operators and apply() that are evaluated lazily,
+    so that a whole expression is computed in one pass (see
+    MatrixExpr).</li>
+
     <li> Stream insertion and extraction operators to conveniently
     load and print values.</li>
     
     </ul>
+
+    The values are stored in one 64-byte aligned buffer, row after
+    row.  Each row starts stride() values after the previous one.
+    Rows of at least PadCols columns are padded to a multiple of 8
+    values so that every row starts on a cache line; narrower
+    matrices (such as the column vectors used by NeuralNet) are stored
+    without padding.  The padding is always zero.
 */
-class Matrix : public TwoDVec {
+class Matrix {
     /** Stream insertion operator to ease printing matrices
      *
      * This method prints the dimension of the matrix and then prints
@@ -84,185 +183,205 @@ public:
     explicit Matrix(const size_t rows = 0, const size_t cols = 0,
                     const Val initVal = 0);
 
+    /** Copies the values (and padding) of another matrix. */
+    Matrix(const Matrix&) = default;
+    Matrix& operator=(const Matrix&) = default;
+
+    /**
+     * Moves the buffer of another matrix into this one without
+     * copying the values.  The other matrix is left empty (0 x 0 with
+     * a stride of 0), so that it can be reused or assigned to.
+     */
+    Matrix(Matrix&& other) noexcept;
+    Matrix& operator=(Matrix&& other) noexcept;
+
+    /** Rows with at least these many columns are padded so that each
+        row starts on a 64-byte boundary. */
+    static constexpr size_t PadCols = 64;
+
+    /** The least number of values an element-wise operation or
+        transpose() gives each thread. */
+    static constexpr size_t ParallelVals = 1 << 16;
+
+    /** The least number of values apply() gives each thread.  It is
+        lower than for the other operations, as the unary operations
+        (such as a sigmoid) cost more than an add. */
+    static constexpr size_t ParallelApplyVals = 1 << 12;
+
     /**
      * Returns the height or number of rows in this matrix.
      *
      * \return Returns the height or number of rows in this matrix.
      */
-    int height() const { return size(); }
+    int height() const { return numRows; }
 
     /**
      * Returns the width or number of columns in this matrix.
      *
      * \return Returns the width or number of columns in this matrix.
      */
-    int width() const { return (height() > 0) ? front().size() : 0; }
+    int width() const { return numCols; }
+
+    /**
+     * Returns the number of values from the start of one row to the
+     * start of the next.  This is at least width().
+     */
+    size_t stride() const { return rowStride; }
+
+    /**
+     * Returns true if this matrix has no rows.
+     */
+    bool empty() const { return numRows == 0; }
+
+    /**
+     * Returns the buffer of values.  Row r starts at data() + r *
+     * stride().
+     */
+    Val* data() { return values.data(); }
+    const Val* data() const { return values.data(); }
+
+    /**
+     * Returns a view of a given row, so that values can be accessed
+     * as matrix[row][col].
+     *
+     * \param[in] row The index of the row.  It is not checked.
+     */
+    MatrixRow<Val> operator[](const size_t row) {
+        return {values.data() + row * rowStride, numCols};
+    }
+
+    MatrixRow<const Val> operator[](const size_t row) const {
+        return {values.data() + row * rowStride, numCols};
+    }
     
     /**
-     * Creates a new matrix in which each value is obtained by
+     * Evaluates a lazy element-wise expression (see MatrixExpr) into
+     * a new matrix, in one pass over the values.
+     *
+     * \param[in] expr The expression, such as (a - b) * c.
+     */
+    template<typename Expr, typename = std::enable_if_t<
+                 IsMatrixExpr<std::decay_t<Expr>>>>
+    Matrix(Expr&& expr) { assign(std::forward<Expr>(expr)); }
+
+    /**
+     * Evaluates a lazy element-wise expression into this matrix.  If
+     * the dimensions are unchanged the values are overwritten in
+     * place, so the expression may use this matrix: each value only
+     * depends on the values at the same position.  Otherwise, the
+     * buffer of a temporary matrix moved into the expression (as in
+     * std::move(a) + b, or the result of dot() in a.dot(b) + c) is
+     * reused, if any.
+     *
+     * \param[in] expr The expression, such as (a - b) * c.
+     */
+    template<typename Expr, typename = std::enable_if_t<
+                 IsMatrixExpr<std::decay_t<Expr>>>>
+    Matrix& operator=(Expr&& expr) {
+        assign(std::forward<Expr>(expr));
+        return *this;
+    }
+
+    /**
+     * Returns a lazy matrix in which each value is obtained by
      * applying a given unary operator to each entry in the matrix.
+     * The values are computed when the result is assigned to a
+     * Matrix, in the same pass as the rest of the expression.
      *
      * \param[in] operation The unary operation to be used to create
-     * the given matrix.
+     * the given matrix.  It must not have side effects, as it may be
+     * called in any order and from several threads.
      */
     template<typename UnaryOp>
-    Matrix apply(const UnaryOp& operation) const {
-        // If the matrix is empty, then we have nothing to do.
-        if (empty()) {
-            return *this;  // return copy of empty matrix.
-        }
-        // Now apply the specified operation to each element and store it
-        // in the new matrix
-        Matrix result = *this;  // Initialize to current values.
-        // Apply unary operation to each element in the result
-        for (auto& row : result) {
-            for (auto& val : row) {
-                val = operation(val);
-            }
-        }
-        // The resulting matrix after applying specified operations.
-        return result;
-    }
+    auto apply(const UnaryOp& operation) const&;
+
+    /** Overload for temporary matrices, which are moved into the
+        expression so that it can outlive them. */
+    template<typename UnaryOp>
+    auto apply(const UnaryOp& operation) &&;
 
     /**
-     * Creates a new matrix in which each value is obtained by
+     * Returns a lazy matrix in which each value is obtained by
      * applying a given binary operator to each entry in this matrix
-     * and another matrix.
+     * and another matrix (or expression).
      *
      * \param[in] other The other matrix to be used. Note that the
      * other matrix must be exactly the same dimension of this this.
-     * Otherwise, this method throws an exception.
      *
      * \param[in] operation The binary operation to be used to create
      * each value in the given matrix.
-     */    
-    template<typename BinaryOp>
-    Matrix apply(const Matrix& other, const BinaryOp& operation) const {
-        // Check to ensure the number of rows are the same.
-        assert(size() == other.size());
-        // If the matrix is empty, then we have nothing to do.
-        if (empty()) {
-            return *this;  // return copy of empty matrix.
-        }
-        // Ensure the number of columns match.
-        assert(front().size() == other.front().size());
-        // Now apply the specified operation to each element and store it
-        // in the new matrix
-        Matrix result = *this;  // Initialize to current values.
-        // Here we use index so that we can access the corresponding
-        // element in the other matrix as well.
-        for (size_t row = 0; (row < size()); ++row) {
-            for (size_t col = 0; (col < (*this)[row].size()); ++col) {
-                // Recollect result is initialized to values of this
-                // matrix. So we use result to reduce the number of
-                // different values accessed.
-                result[row][col] = operation(result[row][col], other[row][col]);
-            }
-        }
-        // The resulting matrix after applying specified operations.
-        return result;
-    }
+     */
+    template<typename Other, typename BinaryOp>
+    auto apply(Other&& other, const BinaryOp& operation) const&;
+
+    template<typename Other, typename BinaryOp>
+    auto apply(Other&& other, const BinaryOp& operation) &&;
 
     /**
-     * Operator to add two matrices with the same dimensions together.
+     * Replaces each value in this matrix with the value obtained by
+     * applying a given unary operator to it.
      *
-     * \param[in] rhs The other matrix to be used.  This matrix must
-     * have the same dimension as this matrix.  Otherwise this method
-     * throws an excpetion.
+     * \param[in] operation The unary operation to be applied.
      *
-     * \return The resulting matrix in which each value has been
-     * computed by adding the corresponding values from \c this and
-     * rhs.
+     * \return This matrix.
      */
-    Matrix operator+(const Matrix& rhs) const {
-        return apply(rhs, [](const auto& v1, const auto& v2) {
-                              return v1 + v2; });
+    template<typename UnaryOp>
+    Matrix& applyInPlace(const UnaryOp& operation) {
+        return *this = apply(operation);
     }
 
     /**
-     * Operator for computing the Hadamard product of two matrices
-     * with the same dimensions.
+     * Adds another matrix with the same dimensions to this matrix, in
+     * place.  The other in-place operators below are similar.
      *
-     * \param[in] rhs The other matrix to be used.  This matrix must
-     * have the same dimension as this matrix.  Otherwise this method
-     * throws an excpetion.
-     *
-     * \return The resulting matrix in which each value has been
-     * computed by multiplying the corresponding values from \c this
-     * and rhs.
+     * \return This matrix.
      */
-    Matrix operator*(const Matrix& rhs) const {
-        return apply(rhs, [](const auto& v1, const auto& v2) {
-                              return v1 * v2; });
-    }
+    Matrix& operator+=(const Matrix& rhs);
+    Matrix& operator-=(const Matrix& rhs);
+
+    /** Hadamard product in place */
+    Matrix& operator*=(const Matrix& rhs);
+
+    /** Multiplies each value in this matrix by a given value. */
+    Matrix& operator*=(const Val val);
 
     /**
-     * Operator for computing the Hadamard product of two matrices
-     * with the same dimensions.
+     * Evaluates an expression with the same dimensions as this
+     * matrix and adds its values to this matrix, in one pass, e.g.,
+     * weights -= nablaW * eta.  The other in-place operators below
+     * are similar.
      *
-     * \param[in] rhs The other matrix to be used.  This matrix must
-     * have the same dimension as this matrix.  Otherwise this method
-     * throws an excpetion.
-     *
-     * \return The resulting matrix in which each value has been
-     * computed by multiplying the corresponding values from \c this
-     * and rhs.
+     * \return This matrix.
      */
-    Matrix operator*(const Val val) const {
-        return apply([val](const auto& v) { return v * val; });
-    }
-    
+    template<typename Expr, typename = std::enable_if_t<
+                 IsMatrixExpr<std::decay_t<Expr>>>>
+    Matrix& operator+=(Expr&& expr);
+
+    template<typename Expr, typename = std::enable_if_t<
+                 IsMatrixExpr<std::decay_t<Expr>>>>
+    Matrix& operator-=(Expr&& expr);
+
+    template<typename Expr, typename = std::enable_if_t<
+                 IsMatrixExpr<std::decay_t<Expr>>>>
+    Matrix& operator*=(Expr&& expr);
+
     /**
-     * Operator to subtract two matrices with the same dimensions.
-     *
-     * \param[in] rhs The other matrix to be used.  This matrix must
-     * have the same dimension as this matrix.  Otherwise this method
-     * throws an excpetion.
-     *
-     * \return The resulting matrix in which each value has been
-     * computed by subtracting the corresponding values from \c this
-     * and rhs.
+     * Subtracts another matrix with the same dimensions from this
+     * matrix, in place.  This is the same as operator-=().
      */
-    Matrix operator-(const Matrix& rhs) const {
-        return apply(rhs, [](const auto& v1, const auto& v2)  {
-                              return v1 - v2; });
-    }
-
-    void subtract(Matrix& matrix) {
-        // make sure each matrix has same number of rows
-        assert(size() == matrix.size());
-        // If the matrix is empty, then we have nothing to do.
-        if (empty()) {
-            return;  // return copy of empty matrix.
-        }
-        // Ensure the number of columns match.
-        assert(front().size() == matrix.front().size());
-
-        // subtract matrices at each position
-        for (size_t row = 0; (row < size()); row++) {
-            for (size_t col = 0; (col < front().size()); col++) {
-                (*this)[row][col] -= matrix[row][col];
-            }
-        }
-    }
+    void subtract(const Matrix& matrix) { *this -= matrix; }
 
-    void mul(const Val val) {
-        // If the matrix is empty, then we have nothing to do.
-        if (empty()) {
-            return;  // return copy of empty matrix.
-        }
+    /**
+     * Multiplies each value in this matrix by a given value, in
+     * place.  This is the same as operator*=().
+     */
+    void mul(const Val val) { *this *= val; }
 
-        // subtract matrices at each position
-        for (size_t row = 0; (row < size()); row++) {
-            for (size_t col = 0; (col < front().size()); col++) {
-                (*this)[row][col] *= val;
-            }
-        }
-    }
-    
     /**
      * Performs the dot product of two matrices. This method has a
-     * O(n^3) time complexity.
+     * O(n^3) time complexity.  Large products are computed with
+     * cache-blocked, packed panels and a register-tiled kernel (see
+     * gemm() in Matrix.cpp); small ones with a row-by-row loop.
      *
      * \param[in] rhs The other matrix to be used.  This matrix must
      * have the same number of rows as the number of columns in this
@@ -275,10 +394,448 @@ public:
     Matrix dot(const Matrix& rhs) const;
 
     /**
-     * Returns the transpose of this matrix.
+     * Computes the dot product of this matrix and rhs into a given
+     * matrix, reusing its buffer if it already has the dimensions of
+     * the result, so that repeated products do not allocate memory.
+     *
+     * \param[in] rhs The other matrix to be used, as in dot().
+     *
+     * \param[out] result The matrix to hold the product.  It must not
+     * be this matrix or rhs.
+     */
+    void dotInto(const Matrix& rhs, Matrix& result) const;
+
+    /**
+     * Performs the dot product of this matrix and the transpose of
+     * rhs, i.e., this . rhs^T, without creating the transpose: each
+     * value is the dot product of a row of this matrix and a row of
+     * rhs.  For column vectors this is their outer product.
+     *
+     * \param[in] rhs The other matrix to be used.  It must have the
+     * same number of columns as this matrix.
+     */
+    Matrix dotTransB(const Matrix& rhs) const;
+
+    /** Same as dotTransB(), into a given matrix as in dotInto(). */
+    void dotTransBInto(const Matrix& rhs, Matrix& result) const;
+
+    /**
+     * Performs the dot product of the transpose of this matrix and
+     * rhs, i.e., this^T . rhs, without creating the transpose: the
+     * rows of rhs are scaled by the columns of this matrix.
+     *
+     * \param[in] rhs The other matrix to be used.  It must have the
+     * same number of rows as this matrix.
+     */
+    Matrix dotTransA(const Matrix& rhs) const;
+
+    /** Same as dotTransA(), into a given matrix as in dotInto(). */
+    void dotTransAInto(const Matrix& rhs, Matrix& result) const;
+
+    /**
+     * Returns the transpose of this matrix.  It is copied in blocks
+     * that fit in the L1 cache, each of which is transposed a few
+     * rows at a time in SIMD registers.
      */
     Matrix transpose() const;
+
+    /**
+     * Transposes this matrix.  A square matrix is transposed in its
+     * own buffer, by swapping blocks across the diagonal; any other
+     * matrix is replaced by transpose().
+     */
+    void transposeInPlace();
+
+    /**
+     * Returns the name of the SIMD kernels used by the element-wise
+     * operators and dot(): "avx512", "avx2", or "scalar".  The best
+     * kernels the CPU supports are picked when they are first used,
+     * unless the MATRIX_SIMD environment variable names others.
+     */
+    static std::string simd();
+
+    /**
+     * Selects the SIMD kernels to be used.  This is meant for testing
+     * and benchmarking, and must not be called while other threads
+     * are using matrices.
+     *
+     * \param[in] isa "avx512", "avx2", or "scalar".
+     *
+     * \return False (and the kernels are unchanged) if the kernels
+     * are unknown or not supported by this CPU.
+     */
+    static bool setSimd(const std::string& isa);
+
+    /**
+     * Returns the number of threads used by the operations on large
+     * matrices: the count given to setThreads(), or else the
+     * MATRIX_THREADS environment variable, or else the OpenMP default
+     * (OMP_NUM_THREADS or the number of cores).  It is 1 unless the
+     * program is compiled with -fopenmp.
+     */
+    static int threads();
+
+    /**
+     * Sets the number of threads used by the operations on large
+     * matrices.  Like setSimd(), this must not be called while other
+     * threads are using matrices.
+     *
+     * \param[in] count The number of threads.  Zero restores the
+     * default.
+     */
+    static void setThreads(const int count);
+
+    /**
+     * Returns the number of threads to be used for an operation that
+     * does a given amount of work: at most threads(), but few enough
+     * that each gets at least minWork.  Operations on small matrices
+     * thus stay on the calling thread.
+     */
+    static int threadsFor(const size_t work, const size_t minWork);
+
+private:
+    /**
+     * Creates a matrix whose values are left uninitialized (the
+     * padding is zero), for results that overwrite every value.
+     */
+    static Matrix uninitialized(const size_t rows, const size_t cols);
+
+    /**
+     * Computes the product of lhs (or its transpose, if transLhs is
+     * true) and rhs (or its transpose) into result, which must not be
+     * lhs or rhs.  This does the work of dotInto() and its variants.
+     */
+    static void multiply(const Matrix& lhs, const bool transLhs,
+                         const Matrix& rhs, const bool transRhs,
+                         Matrix& result);
+
+    /**
+     * Evaluates an expression into this matrix (see operator=()).
+     */
+    template<typename Expr>
+    void assign(Expr&& expr);
+
+    /**
+     * Computes the values of an expression into this matrix, which
+     * is resized if its dimensions differ.
+     */
+    template<typename Expr>
+    void evaluate(const Expr& expr);
+
+    /** The number of rows and columns in this matrix */
+    size_t numRows = 0, numCols = 0;
+    /** The number of values from the start of one row to the next */
+    size_t rowStride = 0;
+    /** The values, row after row, including any padding */
+    std::vector<Val, AlignedAllocator<Val>> values;
 };
 
+/** How an expression stores an operand of type T (as deduced for a
+    forwarding reference): named matrices and expressions (lvalues)
+    are referenced, temporaries are moved into the expression. */
+template<typename T>
+using ExprArg = std::conditional_t<std::is_lvalue_reference<T>::value,
+                                   const std::decay_t<T>&, std::decay_t<T>>;
+
+/** True for the operations of the arithmetic operators, which are
+    cheaper than the operations given to apply(). */
+template<typename Op>
+constexpr bool IsArithmeticOp = false;
+
+/** The operation of matrix * value */
+struct ScaleOp {
+    Val val;
+    Val operator()(const Val v) const { return v * val; }
+};
+
+template<> constexpr bool IsArithmeticOp<std::plus<Val>> = true;
+template<> constexpr bool IsArithmeticOp<std::minus<Val>> = true;
+template<> constexpr bool IsArithmeticOp<std::multiplies<Val>> = true;
+template<> constexpr bool IsArithmeticOp<ScaleOp> = true;
+
+/** Returns true if an operand is an expression that calls an
+    operation given to apply(). */
+template<typename T>
+constexpr bool callsApply() {
+    if constexpr (IsMatrixExpr<std::decay_t<T>>) {
+        return std::decay_t<T>::Applies;
+    } else {
+        return false;
+    }
+}
+
+/** Returns the value at a given position of an operand. */
+inline Val exprValue(const Matrix& mat, const size_t row, const size_t col) {
+    return mat[row][col];
+}
+
+template<typename Derived>
+Val exprValue(const MatrixExpr<Derived>& expr, const size_t row,
+              const size_t col) {
+    return expr.self()(row, col);
+}
+
+/** Returns the matrix that an operand owns, i.e., a temporary moved
+    into an expression whose buffer can hold the result, or nullptr
+    if it only references matrices. */
+inline Matrix* exprOwned(Matrix& mat) { return &mat; }
+inline Matrix* exprOwned(const Matrix&) { return nullptr; }
+
+template<typename Derived>
+Matrix* exprOwned(MatrixExpr<Derived>& expr) {
+    return static_cast<Derived&>(expr).ownedMatrix();
+}
+
+template<typename Derived>
+Matrix* exprOwned(const MatrixExpr<Derived>&) { return nullptr; }
+
+template<typename Op, typename Arg>
+class UnaryExpr;
+
+/** The base class of the lazy expressions returned by the
+    element-wise operators and apply().  An expression only records
+    its operands and operation; the values are computed when it is
+    assigned to a Matrix.  So
+
+        inputs = (weights.dot(inputs) + biases).apply(sigmoid);
+
+    runs one loop that reads each operand once and writes the result,
+    instead of creating a temporary matrix (and making a pass over
+    memory) for each operator.  dot() and transpose() are not
+    element-wise, and still return a Matrix.
+
+    Since operands that are named matrices are referenced, an
+    expression stored in a variable (e.g., declared with auto) must
+    not outlive them.  Such a variable holds the expression rather
+    than its values, which are computed again each time it is used.
+
+    Derived must provide height(), width(), operator()(row, col) that
+    returns a value, ownedMatrix() (see exprOwned()), and a constant
+    Applies that is true if an operation given to apply() is called
+    (see Matrix::evaluate()).
+*/
+template<typename Derived>
+class MatrixExpr {
+public:
+    /** Returns this expression as its actual type. */
+    const Derived& self() const {
+        return static_cast<const Derived&>(*this);
+    }
+
+    /**
+     * Returns a lazy matrix in which each value is obtained by
+     * applying a given unary operator to each value of this
+     * expression.  See Matrix::apply().
+     */
+    template<typename UnaryOp>
+    auto apply(const UnaryOp& operation) const& {
+        return UnaryExpr<std::decay_t<UnaryOp>, const Derived&>(self(),
+                                                                 operation);
+    }
+
+    template<typename UnaryOp>
+    auto apply(const UnaryOp& operation) && {
+        return UnaryExpr<std::decay_t<UnaryOp>, Derived>(
+            std::move(static_cast<Derived&>(*this)), operation);
+    }
+};
+
+/** A lazy matrix whose values are given by an operation on the values
+    of an operand (a Matrix or an expression). */
+template<typename Op, typename Arg>
+class UnaryExpr : public MatrixExpr<UnaryExpr<Op, Arg>> {
+public:
+    static constexpr bool Applies = !IsArithmeticOp<Op> || callsApply<Arg>();
+
+    UnaryExpr(Arg&& arg, const Op& op) : arg(std::forward<Arg>(arg)),
+                                         op(op) {}
+
+    int height() const { return arg.height(); }
+    int width()  const { return arg.width();  }
+
+    Val operator()(const size_t row, const size_t col) const {
+        return op(exprValue(arg, row, col));
+    }
+
+    Matrix* ownedMatrix() { return exprOwned(arg); }
+
+private:
+    /** The operand, a reference or a moved temporary */
+    Arg arg;
+    /** The operation applied to each value */
+    Op op;
+};
+
+/** A lazy matrix whose values are given by an operation on the values
+    at the same position in two operands with the same dimensions. */
+template<typename Op, typename Lhs, typename Rhs>
+class BinaryExpr : public MatrixExpr<BinaryExpr<Op, Lhs, Rhs>> {
+public:
+    static constexpr bool Applies = !IsArithmeticOp<Op> ||
+        callsApply<Lhs>() || callsApply<Rhs>();
+
+    BinaryExpr(Lhs&& lhs, Rhs&& rhs, const Op& op) :
+        lhs(std::forward<Lhs>(lhs)), rhs(std::forward<Rhs>(rhs)), op(op) {
+        // Ensure the number of rows and columns match.
+        assert(this->lhs.height() == this->rhs.height());
+        assert(this->lhs.width() == this->rhs.width());
+    }
+
+    int height() const { return lhs.height(); }
+    int width()  const { return lhs.width();  }
+
+    Val operator()(const size_t row, const size_t col) const {
+        return op(exprValue(lhs, row, col), exprValue(rhs, row, col));
+    }
+
+    Matrix* ownedMatrix() {
+        Matrix* owned = exprOwned(lhs);
+        return (owned != nullptr) ? owned : exprOwned(rhs);
+    }
+
+private:
+    /** The operands, references or moved temporaries */
+    Lhs lhs;
+    Rhs rhs;
+    /** The operation applied to each pair of values */
+    Op op;
+};
+
+/**
+ * Operator to add two matrices (or expressions) with the same
+ * dimensions together.
+ *
+ * \return A lazy matrix in which each value is the sum of the
+ * corresponding values from lhs and rhs.
+ */
+template<typename Lhs, typename Rhs, typename = std::enable_if_t<
+             IsMatrixOperand<Lhs> && IsMatrixOperand<Rhs>>>
+auto operator+(Lhs&& lhs, Rhs&& rhs) {
+    return BinaryExpr<std::plus<Val>, ExprArg<Lhs>, ExprArg<Rhs>>(
+        std::forward<Lhs>(lhs), std::forward<Rhs>(rhs), {});
+}
+
+/**
+ * Operator to subtract two matrices (or expressions) with the same
+ * dimensions.
+ *
+ * \return A lazy matrix in which each value is the difference of the
+ * corresponding values from lhs and rhs.
+ */
+template<typename Lhs, typename Rhs, typename = std::enable_if_t<
+             IsMatrixOperand<Lhs> && IsMatrixOperand<Rhs>>>
+auto operator-(Lhs&& lhs, Rhs&& rhs) {
+    return BinaryExpr<std::minus<Val>, ExprArg<Lhs>, ExprArg<Rhs>>(
+        std::forward<Lhs>(lhs), std::forward<Rhs>(rhs), {});
+}
+
+/**
+ * Operator for computing the Hadamard product of two matrices (or
+ * expressions) with the same dimensions.
+ *
+ * \return A lazy matrix in which each value is the product of the
+ * corresponding values from lhs and rhs.
+ */
+template<typename Lhs, typename Rhs, typename = std::enable_if_t<
+             IsMatrixOperand<Lhs> && IsMatrixOperand<Rhs>>>
+auto operator*(Lhs&& lhs, Rhs&& rhs) {
+    return BinaryExpr<std::multiplies<Val>, ExprArg<Lhs>, ExprArg<Rhs>>(
+        std::forward<Lhs>(lhs), std::forward<Rhs>(rhs), {});
+}
+
+/**
+ * Operator to multiply each value of a matrix (or expression) by a
+ * given value.
+ *
+ * \return A lazy matrix with the scaled values.
+ */
+template<typename Arg, typename = std::enable_if_t<IsMatrixOperand<Arg>>>
+auto operator*(Arg&& arg, const Val val) {
+    return UnaryExpr<ScaleOp, ExprArg<Arg>>(std::forward<Arg>(arg),
+                                            ScaleOp{val});
+}
+
+template<typename UnaryOp>
+auto Matrix::apply(const UnaryOp& operation) const& {
+    return UnaryExpr<std::decay_t<UnaryOp>, const Matrix&>(*this, operation);
+}
+
+template<typename UnaryOp>
+auto Matrix::apply(const UnaryOp& operation) && {
+    return UnaryExpr<std::decay_t<UnaryOp>, Matrix>(std::move(*this),
+                                                    operation);
+}
+
+template<typename Other, typename BinaryOp>
+auto Matrix::apply(Other&& other, const BinaryOp& operation) const& {
+    return BinaryExpr<std::decay_t<BinaryOp>, const Matrix&, ExprArg<Other>>(
+        *this, std::forward<Other>(other), operation);
+}
+
+template<typename Other, typename BinaryOp>
+auto Matrix::apply(Other&& other, const BinaryOp& operation) && {
+    return BinaryExpr<std::decay_t<BinaryOp>, Matrix, ExprArg<Other>>(
+        std::move(*this), std::forward<Other>(other), operation);
+}
+
+template<typename Expr>
+void Matrix::assign(Expr&& expr) {
+    if constexpr (!std::is_lvalue_reference<Expr>::value) {
+        // Unless this matrix can hold the result, use the buffer of a
+        // temporary matrix in the expression.  Its values are
+        // overwritten in place, as each value only depends on the
+        // values at the same position.  This is also the case in
+        // x = std::move(x) + b: x is left 0 x 0 once moved into the
+        // expression, so the result goes into its old buffer.
+        Matrix* owned = expr.ownedMatrix();
+        if ((owned != nullptr) &&
+            ((size_t(expr.height()) != numRows) ||
+             (size_t(expr.width()) != numCols))) {
+            owned->evaluate(expr);
+            *this = std::move(*owned);
+            return;
+        }
+    }
+    evaluate(expr);
+}
+
+template<typename Expr, typename>
+Matrix& Matrix::operator+=(Expr&& expr) {
+    assign(*this + std::forward<Expr>(expr));
+    return *this;
+}
+
+template<typename Expr, typename>
+Matrix& Matrix::operator-=(Expr&& expr) {
+    assign(*this - std::forward<Expr>(expr));
+    return *this;
+}
+
+template<typename Expr, typename>
+Matrix& Matrix::operator*=(Expr&& expr) {
+    assign(*this * std::forward<Expr>(expr));
+    return *this;
+}
+
+template<typename Expr>
+void Matrix::evaluate(const Expr& expr) {
+    // An expression can only use this matrix if it has the same
+    // dimensions, in which case the values are overwritten in place.
+    if ((size_t(expr.height()) != numRows) ||
+        (size_t(expr.width()) != numCols)) {
+        *this = uninitialized(expr.height(), expr.width());
+    }
+    // Compute each value of the expression in one pass.  The rows
+    // are split between threads for large matrices.
+    #pragma omp parallel for schedule(static) \
+        num_threads(threadsFor(numRows * numCols, Expr::Applies ? \
+                               ParallelApplyVals : ParallelVals))
+    for (size_t row = 0; (row < numRows); row++) {
+        Val* dest = (*this)[row].data();
+        for (size_t col = 0; (col < numCols); col++) {
+            dest[col] = expr(row, col);
+        }
+    }
+}
 
 #endif
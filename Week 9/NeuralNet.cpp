@@ -79,7 +79,7 @@ void NeuralNet::learn(const Matrix& inputs, const Matrix& exp, const Val eta) {
     // ----------------[ Now do the backward pass ]-----------------
     // This pass computes nabla (∇) in weights and biases so that the
     // network can be suitably updated to minimize errors.
-    auto delta = (activations.back() - exp) * zs.back().apply(invSigmoid);
+    Matrix delta = (activations.back() - exp) * zs.back().apply(invSigmoid);
 
 
     // Create intermediate bias and weights matrices to be updated as
@@ -88,16 +88,16 @@ void NeuralNet::learn(const Matrix& inputs, const Matrix& exp, const Val eta) {
     // Store the delta for use in the interations below
     nabla_b.push_back(delta);
     const int lastLyr = layerSizes[0].size() - 1;
-    nabla_w.push_back(delta.dot(activations.at(lastLyr - 1).transpose()));
+    nabla_w.push_back(delta.dotTransB(activations.at(lastLyr - 1)));
 
     // We propagate the errors backwards (to correct weights and
     // biases), from the outputs back to the inputs. Note that the
     // order of zs and nabla values are from output to input order.
     for (auto lyr = 2; (lyr <= lastLyr); lyr++) {
         const auto sp = zs[lastLyr - lyr].apply(invSigmoid);
-        delta = weights[lastLyr - lyr + 1].transpose().dot(delta) * sp;
+        delta = weights[lastLyr - lyr + 1].dotTransA(delta) * sp;
         nabla_b.push_back(delta);
-        nabla_w.push_back(delta.dot(activations[lastLyr - lyr].transpose()));
+        nabla_w.push_back(delta.dotTransB(activations[lastLyr - lyr]));
     }
 
     /* Debugging code
@@ -113,12 +113,9 @@ void NeuralNet::learn(const Matrix& inputs, const Matrix& exp, const Val eta) {
     // order. So here we use revLyr variabe to ease accounting for the
     // reverse order in nabla_w and nabla_b
     for (auto lyr = 0, revLyr = lastLyr - 1; (lyr < lastLyr); lyr++, revLyr--) {
-        // weights[lyr] = weights[lyr] - (nabla_w[revLyr] * eta);
-        // biases[lyr]  = biases[lyr]  - (nabla_b[revLyr] * eta);
-        nabla_b[revLyr].mul(eta);
-        nabla_w[revLyr].mul(eta);
-        weights[lyr].subtract(nabla_w[revLyr]);
-        biases[lyr].subtract(nabla_b[revLyr]);
+        // Each update is done in place, in one pass.
+        weights[lyr] -= nabla_w[revLyr] * eta;
+        biases[lyr]  -= nabla_b[revLyr] * eta;
     }
 }
 
@@ -143,15 +143,19 @@ void train(NeuralNet& net, const std::string& path, const int limit = 1e6,
 
 /**
  * Helper method to get the index of the maximum element in a given
- * list. For example maxElemIndex({1, 3, -1, 2}) returns 1.
+ * column matrix. For example, for a column with the values 1, 3, -1,
+ * and 2, maxElemIndex returns 1.
  *
- * \param[in] vec The vector whose maximum element index is to be
- * returned by this method. This list cannot be empty.
+ * \param[in] column The column matrix whose maximum element index is
+ * to be returned by this method. It cannot be empty.  Its values are
+ * read in place, as a column is stored contiguously.
  *
  * \return The index position of the maximum element.
  */
-int maxElemIndex(const std::vector<Val>& vec) {
-    return std::max_element(vec.begin(), vec.end()) - vec.begin();
+int maxElemIndex(const Matrix& column) {
+    assert(column.width() == 1);
+    const Val* vals = column.data();
+    return std::max_element(vals, vals + column.height()) - vals;
 }
 
 
@@ -187,8 +191,8 @@ void assess(NeuralNet& net, const std::string& path,
         // Find the maximum index positions in exp results to see if
         // they are the same. If they are it is a good
         // result. Otherwise, it is an error.
-        const int expIdx = maxElemIndex(exp.transpose()[0]);
-        const int resIdx = maxElemIndex(img.transpose()[0]);
+        const int expIdx = maxElemIndex(exp);
+        const int resIdx = maxElemIndex(img);
         if (expIdx == resIdx) {
             passCount++;
         }